@@ -105,6 +105,12 @@ FileSystem::FileSystem(bool format)
 		// pipe
 		freeMap->Mark(PipeSector);
 
+#ifdef USE_DISK
+		// the swap area
+		for (int i = SwapSector; i < NumSectors; i++)
+			freeMap->Mark(i);
+#endif
+
 		// Second, allocate space for the data blocks containing the contents
 		// of the directory and bitmap files.  There better be enough space!
 
@@ -159,6 +165,27 @@ FileSystem::FileSystem(bool format)
 		// the bitmap and directory; these are left open while Nachos is running
 		freeMapFile = new OpenFile(FreeMapSector);
 		directoryFile = new OpenFile(DirectorySector);
+
+#ifdef USE_DISK
+		// A disk formatted before there was a swap area leaves its sectors
+		// free; take them now, before a file is given one.  If files
+		// already hold some of them, the disk has to be formatted again.
+		BitMap *freeMap = new BitMap(NumSectors);
+		int inUse = 0;
+		freeMap->FetchFrom(freeMapFile);
+		for (int i = SwapSector; i < NumSectors; i++)
+			if (freeMap->Test(i))
+				inUse++;
+		ASSERT(inUse == 0 || inUse == NumSwapSectors);	// run with -f
+		if (inUse == 0)
+		{
+			DEBUG('f', "Reserving the swap area.\n");
+			for (int i = SwapSector; i < NumSectors; i++)
+				freeMap->Mark(i);
+			freeMap->WriteBack(freeMapFile);
+		}
+		delete freeMap;
+#endif
 	}
 
 	for(int i=0; i<MAX_FILE_NUMBER; ++i)
@@ -38,6 +38,16 @@
 #include "copyright.h"
 #include "openfile.h"
 
+#ifdef USE_DISK
+#include "disk.h"
+
+// The last sectors of the disk are the swap area for virtual memory
+// (see SwapSpace in addrspace.h).  Formatting marks them in use, so
+// files never get them.
+#define NumSwapSectors		256
+#define SwapSector		(NumSectors - NumSwapSectors)
+#endif
+
 #ifdef MULTI_LEVEL_DIR
 #define Dir_Ext "DIR"
 #endif
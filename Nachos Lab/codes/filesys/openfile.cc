@@ -206,7 +206,7 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
 		freeMap->FetchFrom(freeMapFile);
 
 		// try to extend file, should success
-		ASSERT(hdr->ExpandFileSize(freeMap, numBytes));
+		ASSERT(hdr->ExpandFileSize(freeMap, position+numBytes-fileLength));
 
 		// flush change to disk
 		hdr->WriteBack(hdr->GetHeaderSector());
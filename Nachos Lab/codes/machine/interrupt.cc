@@ -62,7 +62,11 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    maxPending = 16;
+    pending = new PendingInterrupt *[maxPending];
+    numPending = 0;
+    nextSeq = 0;
+    freeList = NULL;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
@@ -75,9 +79,14 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-	delete (PendingInterrupt *)pending->Remove();
-    delete pending;
+    while (numPending > 0)
+	delete pending[--numPending];
+    delete [] pending;
+    while (freeList != NULL) {
+	PendingInterrupt *p = freeList;
+	freeList = p->next;
+	delete p;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -99,7 +108,7 @@ void
 Interrupt::ChangeLevel(IntStatus old, IntStatus now)
 {
     level = now;
-    DEBUG('i',"\tinterrupts: %s -> %s\n",intLevelNames[old],intLevelNames[now]);
+    DEBUG_HOT('i', "\tinterrupts: %s -> %s\n",intLevelNames[old],intLevelNames[now]);
 }
 
 //----------------------------------------------------------------------
@@ -148,21 +157,27 @@ Interrupt::Enable()
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	The basic-block engine (Machine::RunBlock) executes several user
+//	instructions back to back and then charges them all with one
+//	call; interrupts that fell due inside the block fire now.
+//
+//	"ticks" -- how many ticks' worth of time to advance
 //----------------------------------------------------------------------
 void
-Interrupt::OneTick()
+Interrupt::OneTick(int ticks)
 {
     MachineStatus old = status;
 
 // advance simulated time
     if (status == SystemMode) {
-        stats->totalTicks += SystemTick;
-	stats->systemTicks += SystemTick;
+        stats->totalTicks += SystemTick * ticks;
+	stats->systemTicks += SystemTick * ticks;
     } else {					// USER_PROGRAM
-	stats->totalTicks += UserTick;
-	stats->userTicks += UserTick;
+	stats->totalTicks += UserTick * ticks;
+	stats->userTicks += UserTick * ticks;
     }
-    DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
+    DEBUG_HOT('i', "\n== Tick %d ==\n", stats->totalTicks);
 
 // check any pending interrupts are now ready to fire
     ChangeLevel(IntOn, IntOff);		// first, turn off interrupts
@@ -259,7 +274,8 @@ Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: push it onto the "pending" heap, O(log n).  The
+//	PendingInterrupt is taken from the free list if one is there.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -274,13 +290,94 @@ void
 Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 {
     int when = stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(handler, arg, when, type);
+    PendingInterrupt *toOccur;
+
+    if (freeList != NULL) {
+	toOccur = freeList;
+	freeList = toOccur->next;
+	toOccur->handler = handler;
+	toOccur->arg = arg;
+	toOccur->when = when;
+	toOccur->type = type;
+    } else
+	toOccur = new PendingInterrupt(handler, arg, when, type);
 
     DEBUG('i', "Scheduling interrupt handler the %s at time = %d\n", 
 					intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    toOccur->seq = nextSeq++;
+    HeapInsert(toOccur);
+}
+
+//----------------------------------------------------------------------
+// FiresBefore
+// 	The order of the "pending" heap: by time, and among interrupts
+//	due at the same time, in the order they were scheduled (as the
+//	old sorted list kept them).
+//----------------------------------------------------------------------
+
+static inline bool
+FiresBefore(PendingInterrupt *a, PendingInterrupt *b)
+{
+    return (a->when < b->when) || (a->when == b->when && a->seq < b->seq);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::HeapInsert
+// 	Add an interrupt to the "pending" heap, growing the array if it
+//	is full, and sift it up to its place.
+//----------------------------------------------------------------------
+
+void
+Interrupt::HeapInsert(PendingInterrupt *toOccur)
+{
+    if (numPending == maxPending) {
+	PendingInterrupt **bigger = new PendingInterrupt *[maxPending * 2];
+	for (int i = 0; i < numPending; i++)
+	    bigger[i] = pending[i];
+	delete [] pending;
+	pending = bigger;
+	maxPending *= 2;
+    }
+
+    int i = numPending++;
+    while (i > 0 && FiresBefore(toOccur, pending[(i - 1) / 2])) {
+	pending[i] = pending[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+    pending[i] = toOccur;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::HeapRemoveFirst
+// 	Remove and return the interrupt that fires next, pending[0],
+//	moving the last entry to the root and sifting it down.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+Interrupt::HeapRemoveFirst()
+{
+    ASSERT(numPending > 0);
+    PendingInterrupt *first = pending[0];
+    PendingInterrupt *last = pending[--numPending];
+    int i = 0;
+
+    for (;;) {
+	int child = 2 * i + 1;
+	if (child >= numPending)
+	    break;
+	if (child + 1 < numPending && FiresBefore(pending[child + 1], 
+						   pending[child]))
+	    child++;
+	if (!FiresBefore(pending[child], last))
+	    break;
+	pending[i] = pending[child];
+	i = child;
+    }
+    if (numPending > 0)
+	pending[i] = last;
+    return first;
 }
 
 //----------------------------------------------------------------------
@@ -304,28 +401,26 @@ Interrupt::CheckIfDue(bool advanceClock)
 
     ASSERT(level == IntOff);		// interrupts need to be disabled,
 					// to invoke an interrupt handler
-    if (DebugIsEnabled('i'))
+    if (HotDebugIsEnabled('i'))
 	DumpState();
-    PendingInterrupt *toOccur = 
-		(PendingInterrupt *)pending->SortedRemove(&when);
-
-    if (toOccur == NULL)		// no pending interrupts
+    if (numPending == 0)		// no pending interrupts
 	return FALSE;			
 
+    PendingInterrupt *toOccur = pending[0];	// look, but leave it
+    when = toOccur->when;			// there until it fires
     if (advanceClock && when > stats->totalTicks) {	// advance the clock
 	stats->idleTicks += (when - stats->totalTicks);
 	stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {	// not time yet, put it back
-	pending->SortedInsert(toOccur, when);
+    } else if (when > stats->totalTicks) {	// not time yet
 	return FALSE;
     }
 
 // Check if there is nothing more to do, and if so, quit
     if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+				&& numPending == 1) {
 	 return FALSE;
     }
+    (void) HeapRemoveFirst();
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n", 
 			intTypeNames[toOccur->type], toOccur->when);
@@ -340,7 +435,8 @@ Interrupt::CheckIfDue(bool advanceClock)
     (*(toOccur->handler))(toOccur->arg);	// call the interrupt handler
     status = old;				// restore the machine status
     inHandler = FALSE;
-    delete toOccur;
+    toOccur->next = freeList;			// keep it for reuse
+    freeList = toOccur;
     return TRUE;
 }
 
@@ -351,10 +447,8 @@ Interrupt::CheckIfDue(bool advanceClock)
 //----------------------------------------------------------------------
 
 static void
-PrintPending(int arg)
+PrintPending(PendingInterrupt *pend)
 {
-    PendingInterrupt *pend = (PendingInterrupt *)arg;
-
     printf("Interrupt handler %s, scheduled at %d\n", 
 	intTypeNames[pend->type], pend->when);
 }
@@ -370,9 +464,10 @@ Interrupt::DumpState()
 {
     printf("Time: %d, interrupts %s\n", stats->totalTicks, 
 					intLevelNames[level]);
-    printf("Pending interrupts:\n");
+    printf("Pending interrupts (in heap order):\n");
     fflush(stdout);
-    pending->Mapcar(PrintPending);
+    for (int i = 0; i < numPending; i++)
+	PrintPending(pending[i]);
     printf("End of pending interrupts\n");
     fflush(stdout);
 }
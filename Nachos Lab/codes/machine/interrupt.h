@@ -67,6 +67,9 @@ class PendingInterrupt {
     int arg;                    // The argument to the function.
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    int seq;			// Order of scheduling, to fire interrupts
+				// due at the same time first-come first-served
+    PendingInterrupt *next;	// next on the free list, once fired
 };
 
 // The following class defines the data structures for the simulation
@@ -110,12 +113,20 @@ class Interrupt {
 	int arg, int when, IntType type);// at time ``when''.  This is called
     					// by the hardware device simulators.
     
-    void OneTick();       		// Advance simulated time
+    void OneTick(int ticks = 1);	// Advance simulated time, by "ticks"
+					// user instructions at once if the
+					// simulator ran a whole basic block
 
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
-				// to occur in the future
+    PendingInterrupt **pending;	// the interrupts scheduled to occur in
+				// the future, a binary heap ordered by
+				// (when, seq): pending[0] fires next
+    int numPending;		// entries used in "pending",
+    int maxPending;		// and its allocated size
+    int nextSeq;		// "seq" of the next interrupt scheduled
+    PendingInterrupt *freeList;	// fired interrupts, kept for reuse so
+				// Schedule need not allocate
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
@@ -128,6 +139,9 @@ class Interrupt {
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 	IntStatus now);  		// simulated time
+
+    void HeapInsert(PendingInterrupt *toOccur);	// add to "pending"
+    PendingInterrupt *HeapRemoveFirst();	// remove pending[0]
 };
 
 #endif // INTERRRUPT_H
@@ -63,30 +63,68 @@ Machine::Machine(bool debug)
 
     for (i = 0; i < NumTotalRegs; i++)
         registers[i] = 0;
-    mainMemory = new char[MemorySize];
-    for (i = 0; i < MemorySize; i++)
+    numPhysPages = PhysPages;
+    ASSERT(numPhysPages > 0);
+    mainMemory = new char[numPhysPages * PageSize];
+    for (i = 0; i < numPhysPages * PageSize; i++)
       	mainMemory[i] = 0;
+    decodeCache = new Instruction[numPhysPages * InstrPerPage];
+    decodeValid = new bool[numPhysPages * InstrPerPage];
+    for (i = 0; i < numPhysPages * InstrPerPage; i++)
+	decodeValid[i] = FALSE;
+    blockCache = new BasicBlock[BlockCacheSize];
+    for (i = 0; i < BlockCacheSize; i++)
+	blockCache[i].physAddr = -1;
+    frameGen = new unsigned int[numPhysPages];
+    for (i = 0; i < numPhysPages; i++)
+	frameGen[i] = 0;
+    FlushSoftTLB();
+    lastEntry = NULL;
+    coreMap = new CoreMapEntry[numPhysPages];
+    for (i = 0; i < numPhysPages; i++) {
+	coreMap[i].space = NULL;
+	coreMap[i].refs = 0;
+	coreMap[i].prefetched = FALSE;
+	coreMap[i].busy = FALSE;
+    }
+    clockHand = 0;
+#if INVERTED_PAGETABLE || USE_BITMAP
+    freeNext = new int[numPhysPages];
+    for (i = 0; i < numPhysPages; i++)
+	freeNext[i] = (i + 1 < numPhysPages) ? i + 1 : -1;
+    freeFrames = 0;
+    numFree = numPhysPages;
+#endif
 
 #ifndef INVERTED_PAGETABLE
 
 #ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
+    tlbSize = TLBEntries;
+    tlbWays = (TLBWays > 0) ? TLBWays : tlbSize;	// 0: fully associative
+    ASSERT(tlbSize > 0 && tlbSize % tlbWays == 0);
+    tlb = new TranslationEntry[tlbSize];
+    tlbStamp = new unsigned int[tlbSize];
+    for (i = 0; i < tlbSize; i++) {
 	tlb[i].valid = FALSE;
+	tlbStamp[i] = 0;
+    }
+    tlbTicks = 0;
     pageTable = NULL;
+    currentASID = 0;
+    for (i = 0; i < NumASIDs; i++)
+	asidPageTable[i] = NULL;
 #else	// use linear page table
     tlb = NULL;
     pageTable = NULL;
 #endif
 
-#ifdef USE_BITMAP
-    bitmap = 0;
-#endif
-
 #else
-    pageTable = new TranslationEntry[NumPhysPages];
-    pageTableSize = NumPhysPages;
-    for(int i=0; i<NumPhysPages; ++i)
+    tlb = NULL;		// the inverted page table is searched directly
+    pageTable = new TranslationEntry[numPhysPages];
+    pageTableSize = numPhysPages;
+    hashAnchor = new int[numPhysPages];
+    hashNext = new int[numPhysPages];
+    for(int i=0; i<numPhysPages; ++i)
     {
         pageTable[i].virtualPage = -1;
         pageTable[i].physicalPage = -1;
@@ -95,6 +133,8 @@ Machine::Machine(bool debug)
         pageTable[i].readOnly = FALSE;
         pageTable[i].dirty = FALSE;
         pageTable[i].TID = -1;
+        hashAnchor[i] = -1;
+        hashNext[i] = -1;
     }
 #endif
 
@@ -110,8 +150,23 @@ Machine::Machine(bool debug)
 Machine::~Machine()
 {
     delete [] mainMemory;
-    if (tlb != NULL)
+    delete [] decodeCache;
+    delete [] decodeValid;
+    delete [] blockCache;
+    delete [] frameGen;
+    delete [] coreMap;
+#if INVERTED_PAGETABLE || USE_BITMAP
+    delete [] freeNext;
+#endif
+    if (tlb != NULL) {
         delete [] tlb;
+        delete [] tlbStamp;
+    }
+#ifdef INVERTED_PAGETABLE
+    delete [] pageTable;
+    delete [] hashAnchor;
+    delete [] hashNext;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -127,13 +182,15 @@ Machine::~Machine()
 void
 Machine::RaiseException(ExceptionType which, int badVAddr)
 {
-    DEBUG('m', "Exception: %s\n", exceptionNames[which]);
+    DEBUG_HOT('m', "Exception: %s\n", exceptionNames[which]);
     
 //  ASSERT(interrupt->getStatus() == UserMode);
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);			// finish anything in progress
     interrupt->setStatus(SystemMode);
+    FlushSoftTLB();			// the kernel may change translations
     ExceptionHandler(which);		// interrupts are enabled at this point
+    FlushSoftTLB();			// drop what it cached while doing so
     interrupt->setStatus(UserMode);
 }
 
@@ -239,37 +296,71 @@ void Machine::WriteRegister(int num, int value)
 	registers[num] = value;
     }
 
+//----------------------------------------------------------------------
+// Machine::InvalidateFrame
+// 	Drop the predecoded instructions cached for a physical page,
+//	and retire any basic blocks translated from it.
+//	Stores from user code invalidate their own word in WriteMem;
+//	this is for the kernel, which fills frames directly through
+//	mainMemory when it loads or pages in a program.
+//
+//	"frame" -- the physical page whose contents changed
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateFrame(int frame)
+{
+    ASSERT((frame >= 0) && (frame < numPhysPages));
+    for (int i = 0; i < InstrPerPage; i++)
+	decodeValid[frame * InstrPerPage + i] = FALSE;
+    frameGen[frame]++;
+}
+
 #if INVERTED_PAGETABLE || USE_BITMAP
+//----------------------------------------------------------------------
+// Machine::allocateMem
+// 	Take a frame off the free list and return it, or -1 if memory
+//	is full.  With an inverted page table there is nowhere to page 
+//	out to, so running out of memory is fatal.
+//----------------------------------------------------------------------
+
 int
 Machine::allocateMem()
 {
-#ifdef USE_BITMAP
-    for(int pos=0; pos<NumPhysPages; ++pos)
+    int pos = freeFrames;
+
+    if(pos == -1)
     {
-        if((bitmap & (1<<pos)) == 0)
-        {
-            bitmap |= (1<<pos);
-            DEBUG('B', "Allocate frame %d, and bitmap is %08X\n", pos, bitmap);
-            return pos;
-        }
-    }
-    DEBUG('B', "All frames have been used!\n");
-    return -1;
-#endif
 #ifdef INVERTED_PAGETABLE
-    for(int pos=0; pos<NumPhysPages; pos++)
-    {
-        if(!pageTable[pos].valid)
-        {
-            return pos;
-        }
-    }
-    printf("All physical pages have been used!!!\n");
-    ASSERT(FALSE);
-    return -1;
+        printf("All physical pages have been used!!!\n");
+        ASSERT(FALSE);
 #endif
+        DEBUG('B', "All frames have been used!\n");
+        return -1;
+    }
+    freeFrames = freeNext[pos];
+    freeNext[pos] = FrameInUse;
+    numFree--;
+    DEBUG('B', "Allocate frame %d, %d frames left\n", pos, numFree);
+    return pos;
 }
 
+//----------------------------------------------------------------------
+// Machine::freeFrame
+// 	Put "frame", given out by allocateMem, back on the free list.
+//----------------------------------------------------------------------
+
+void
+Machine::freeFrame(int frame)
+{
+    ASSERT(freeNext[frame] == FrameInUse);
+    freeNext[frame] = freeFrames;
+    freeFrames = frame;
+    numFree++;
+    coreMap[frame].space = NULL;
+    coreMap[frame].refs = 0;
+    DEBUG('B', "Free frame %d, %d frames left\n", frame, numFree);
+}
 
 void
 Machine::freeMem()
@@ -280,23 +371,115 @@ Machine::freeMem()
         if(pageTable[i].valid)
         {
             int pos = pageTable[i].physicalPage;
-            bitmap &= (~(1<<pos));
-            DEBUG('B', "Free frame %d, and bitmap is %08X\n", pos, bitmap);
+            if (--coreMap[pos].refs > 0)    // still mapped by a Fork
+            {                               // relative: keep it
+                if (coreMap[pos].space == currentThread->space)
+                    coreMap[pos].space = NULL;
+                continue;
+            }
+            freeFrame(pos);
         }
     }
-    DEBUG('B', "After freeing, bitmap is %08X\n", bitmap);
+    DEBUG('B', "After freeing, %d frames are free\n", numFree);
 #endif
 #ifdef INVERTED_PAGETABLE
-    for(int pos=0; pos<NumPhysPages; ++pos)
+    int tid = currentThread->getTID();
+    for(int vpn=0; vpn<currentThread->space->GetNumPages(); ++vpn)
     {
-        if(pageTable[pos].valid && pageTable[pos].TID==currentThread->getTID())
+        int pos = LookupFrame(tid, vpn);
+        if(pos != -1)
         {
-            pageTable[pos].valid = FALSE;
-            DEBUG('I', "Thread %d has freed physical page %d\n", currentThread->getTID(), pos);
+            UnmapFrame(pos);
+            DEBUG('I', "Thread %d has freed physical page %d\n", tid, pos);
         }
     }
-    DEBUG('I', "Thread %d has freed all physical pages it occupied\n", currentThread->getTID());
+    DEBUG('I', "Thread %d has freed all physical pages it occupied\n", tid);
+#endif
+}
 #endif
+
+#ifdef INVERTED_PAGETABLE
+//----------------------------------------------------------------------
+// Machine::LookupFrame
+// 	Return the frame holding virtual page "vpn" of thread "tid", or
+//	-1 if it is not in memory.  Only the frames on the hash chain of
+//	(tid, vpn) are looked at, not the whole inverted page table.
+//----------------------------------------------------------------------
+
+int
+Machine::LookupFrame(int tid, int vpn)
+{
+    for(int pos=hashAnchor[HashPage(tid, vpn)]; pos!=-1; pos=hashNext[pos])
+    {
+        if(pageTable[pos].virtualPage == vpn && pageTable[pos].TID == tid)
+            return pos;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::MapFrame
+// 	Make "frame", just taken from allocateMem, hold virtual page
+//	"vpn" of thread "tid", and put it on that page's hash chain.
+//----------------------------------------------------------------------
+
+void
+Machine::MapFrame(int frame, int tid, int vpn)
+{
+    int *anchor = &hashAnchor[HashPage(tid, vpn)];
+
+    ASSERT(!pageTable[frame].valid);
+    pageTable[frame].virtualPage = vpn;
+    pageTable[frame].physicalPage = frame;
+    pageTable[frame].valid = TRUE;
+    pageTable[frame].use = FALSE;
+    pageTable[frame].readOnly = FALSE;
+    pageTable[frame].dirty = FALSE;
+    pageTable[frame].TID = tid;
+    hashNext[frame] = *anchor;
+    *anchor = frame;
+}
+
+//----------------------------------------------------------------------
+// Machine::UnmapFrame
+// 	Take "frame" off its hash chain, and put it back on the free
+//	list for allocateMem.
+//----------------------------------------------------------------------
+
+void
+Machine::UnmapFrame(int frame)
+{
+    int *link = &hashAnchor[HashPage(pageTable[frame].TID, 
+                                     pageTable[frame].virtualPage)];
+
+    while(*link != frame)
+    {
+        ASSERT(*link != -1);
+        link = &hashNext[*link];
+    }
+    *link = hashNext[frame];
+    pageTable[frame].valid = FALSE;
+    freeFrame(frame);
+}
+
+//----------------------------------------------------------------------
+// Machine::PrintPageTable
+// 	Print the virtual page, frame and owning thread of every frame in
+//	use.  Free frames are left out, so the table stays readable when
+//	there are many of them.
+//----------------------------------------------------------------------
+
+void
+Machine::PrintPageTable()
+{
+    printf("================PAGE TABLE================\n");
+    for(int i=0; i<numPhysPages; ++i)
+    {
+        if(pageTable[i].valid)
+            printf("%d\t%d\t%d\t%d\n", pageTable[i].virtualPage, 
+                pageTable[i].physicalPage, pageTable[i].valid, pageTable[i].TID);
+    }
+    printf("==========================================\n");
 }
 #endif
 
@@ -32,9 +32,17 @@
 					// the disk sector size, for
 					// simplicity
 
-#define NumPhysPages    32
-#define MemorySize 	(NumPhysPages * PageSize)
-#define TLBSize		4		// if there is a TLB, make it small
+#define DefaultPhysPages 32		// frames of physical memory, unless
+					// -mem says otherwise
+#define FrameInUse	(-2)		// on the free list: frame given out
+#define TLBSize		4		// if there is a TLB, make it small:
+					// the default; see -tlbsize
+#define NumASIDs	8		// address space IDs the TLB can tag
+#define InstrPerPage	(PageSize / 4)	// instruction slots per physical page
+#define MaxBlockLength	32		// longest basic block we translate
+#define BlockCacheSize	256		// translated blocks kept (power of 2)
+#define SoftTLBSize	64		// host-side translation cache entries
+					// (power of 2)
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -91,6 +99,59 @@ class Instruction {
                      // Immediates are sign-extended.
 };
 
+// The following class defines a translated basic block: a run of
+// straight-line instructions starting at a physical address, ending
+// with the delay slot of the first branch or jump (or a syscall, or
+// the end of the page).  The block engine executes the whole run of
+// predecoded micro-ops without refetching, then charges the ticks.
+
+class BasicBlock {
+  public:
+    int physAddr;	// where the block starts in mainMemory, -1 if free
+    unsigned int gen;	// generation of its frame when it was translated
+    int length;		// number of micro-ops in "ops"
+    Instruction ops[MaxBlockLength];
+};
+
+// The following class defines an entry of the software TLB: a host-side,
+// direct-mapped cache of translations that Translate has already
+// checked.  A hit gives a pointer straight into mainMemory, so the
+// common load or store skips the TLB scan and the DEBUG calls.  Entries
+// are only valid while the kernel is not running (see FlushSoftTLB).
+
+class SoftTLBEntry {
+  public:
+    int vpn;			// virtual page cached here, -1 if none
+    char *host;			// the start of its frame in mainMemory
+    bool writable;		// FALSE if the page is read-only
+    TranslationEntry *entry;	// the TLB or page table entry it came
+				// from, for the use and dirty bits
+    int tlbIndex;		// which TLB entry that is, -1 if none;
+				// its hits are stamped for LRU
+};
+
+// The following class defines an entry of the core map, the reverse of
+// the page tables: which address space's page, if any, occupies each
+// physical frame.  Page replacement walks it to pick a victim from
+// any process, not just the one that faulted.
+//
+// After a copy-on-write Fork several address spaces can map a frame,
+// always at the same virtual page.  "refs" counts them; "space" is
+// then just one of them, or NULL if that one let go of the frame first.
+
+class AddrSpace;
+
+class CoreMapEntry {
+  public:
+    AddrSpace *space;		// owner of the page in this frame, 
+				// NULL if the frame is free
+    int vpn;			// which of its pages it is
+    int refs;			// page tables mapping the frame, 0 if free
+    bool prefetched;		// read ahead, and not referenced since
+    bool busy;			// being paged in or out: page replacement
+				// must leave the frame alone
+};
+
 // The following class defines the simulated host workstation hardware, as 
 // seen by user programs -- the CPU registers, main memory, etc.
 // User programs shouldn't be able to tell that they are running on our 
@@ -123,6 +184,24 @@ class Machine {
 
     void OneInstruction(Instruction *instr); 	
     				// Run one instruction of a user program.
+    bool FetchInstruction(Instruction *instr);
+				// Fetch and decode the instruction at PC,
+				// using the predecoded copy if there is one.
+				// Return FALSE if the fetch trapped.
+    bool TranslatePC(int *physAddr);
+				// Translate the PC for an instruction fetch;
+				// raise the exception and return FALSE if
+				// that fails
+    Instruction *Predecode(int physAddr);
+				// The decoded instruction at a physical
+				// address, decoding it if not cached
+    bool ExecuteInstruction(Instruction *instr);
+				// Execute a decoded instruction and advance
+				// the PC.  Return FALSE if it trapped.
+    int RunBlock();		// Run the basic block starting at PC;
+				// return the number of ticks to charge
+    void TranslateBlock(BasicBlock *block, int physAddr);
+				// Build the micro-ops for a basic block
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
     
@@ -139,20 +218,54 @@ class Machine {
     				// and return an exception code if the 
 				// translation couldn't be completed.
 
+    char *SoftTranslate(int virtAddr, int size, bool writing);
+				// Look an address up in the software TLB;
+				// return where it is in mainMemory, or NULL
+				// if the slow path (Translate) must be taken
+    void FillSoftTLB(int virtAddr);
+				// Cache the translation Translate just made
+    void FlushSoftTLB();	// Forget every software TLB entry; called
+				// whenever the kernel may change the TLB or
+				// the page table
+
     void RaiseException(ExceptionType which, int badVAddr);
 				// Trap to the Nachos kernel, because of a
 				// system call or other exception.  
 
     void Debugger();		// invoke the user program debugger
     void DumpState();		// print the user CPU and memory state
+
+    void InvalidateFrame(int frame);
+				// Forget the predecoded instructions of
+				// a physical page, because the kernel
+				// has loaded new contents into it
+    void SyncTLB();		// Copy the TLB's use and dirty bits back
+				// into the page tables
+    void FlushTLB(int asid);	// Sync, then drop the TLB entries
+				// tagged "asid"
+    int TLBSet(int vpn)		// First TLB entry of the set that
+	{ return (vpn % (tlbSize / tlbWays)) * tlbWays; }
+				// page "vpn" may be cached in
     
     /* added by Li cong 1800012826 for lab4 exercise 4*/
-#ifdef USE_BITMAP
-    unsigned bitmap;
-#endif
+    int numPhysPages;		// frames of physical memory
+    CoreMapEntry *coreMap;	// owner of each frame
+    int clockHand;		// next frame the replacement clock looks at
 #if INVERTED_PAGETABLE || USE_BITMAP
-    int allocateMem();
+    int allocateMem();		// Take a free frame, -1 if none
     void freeMem();
+    int numFreeFrames() { return numFree; }
+				// how many frames allocateMem has left
+    void freeFrame(int frame);	// give back one frame
+#endif
+#ifdef INVERTED_PAGETABLE
+    int LookupFrame(int tid, int vpn);	// Frame holding page "vpn" of
+				// thread "tid", or -1
+    void MapFrame(int frame, int tid, int vpn);
+				// Put page "vpn" of "tid" in "frame", 
+				// which allocateMem gave out
+    void UnmapFrame(int frame);	// Empty "frame" and give it back
+    void PrintPageTable();	// Print the frames in use
 #endif
 
 
@@ -168,6 +281,20 @@ class Machine {
 				// code and data, while executing
     int registers[NumTotalRegs]; // CPU registers, for executing user programs
 
+    Instruction *decodeCache;	// predecoded instructions, one slot per
+    bool *decodeValid;		// word of main memory (physical address / 4);
+				// a slot is valid until the word is written
+				// or its page is reloaded
+    SoftTLBEntry softTLB[SoftTLBSize];
+				// host-side translations, by vpn
+    TranslationEntry *lastEntry; // the entry the last successful
+				// Translate used
+
+    BasicBlock *blockCache;	// translated basic blocks, direct mapped
+    				// by start address
+    unsigned int *frameGen;	// per physical page; bumped whenever code
+				// in it changes, which retires its blocks
+
 
 // NOTE: the hardware translation of virtual addresses in the user program
 // to physical addresses (relative to the beginning of "mainMemory")
@@ -189,17 +316,78 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
+    int tlbSize;			// entries in the TLB
+    int tlbWays;			// entries in each set; a page can be
+					// cached only in the set TLBSet picks
+    unsigned int *tlbStamp;		// tlbTicks at each entry's last hit
+    unsigned int tlbTicks;		// TLB hits so far
+    int currentASID;			// tag of the TLB entries in use: the
+					// running address space's ID
+    TranslationEntry *asidPageTable[NumASIDs];
+    unsigned int asidPageTableSize[NumASIDs];
+					// the page table each address space
+					// ID stands for, NULL if unused; 
+					// SyncTLB writes bits back to them
 
     TranslationEntry *pageTable;
     unsigned int pageTableSize;
 
   private:
+#if INVERTED_PAGETABLE || USE_BITMAP
+    // Free frames are kept on a list, so allocateMem and freeFrame
+    // take constant time however large memory is: freeFrames is the
+    // first free frame, freeNext[frame] the next, -1 the end.  A frame
+    // given out has freeNext FrameInUse.
+    int *freeNext;
+    int freeFrames;
+    int numFree;
+#endif
+#ifdef INVERTED_PAGETABLE
+    // The inverted page table has one entry per frame.  To find the
+    // frame of (TID, vpn) without searching it, frames are chained
+    // from a hash anchor table: hashAnchor[HashPage(tid, vpn)] is the
+    // first frame of the chain, hashNext[frame] the next, -1 the end.
+    int *hashAnchor;
+    int *hashNext;
+    int HashPage(int tid, int vpn)
+	{ return ((unsigned) tid * 2654435761u + vpn) % numPhysPages; }
+#endif
+
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
 				// time reaches this value
 };
 
+//----------------------------------------------------------------------
+// Machine::SoftTranslate
+// 	The fast path of ReadMem, WriteMem and instruction fetch.  On a
+//	hit we still count the reference and set the use and dirty bits,
+//	exactly as Translate would, so the simulated TLB cannot tell.
+//	Unaligned accesses and writes to read-only pages always miss,
+//	and Translate raises the proper exception for them.
+//----------------------------------------------------------------------
+
+inline char *
+Machine::SoftTranslate(int virtAddr, int size, bool writing)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    SoftTLBEntry *soft = &softTLB[vpn & (SoftTLBSize - 1)];
+
+    if (soft->vpn != (int) vpn || (virtAddr & (size - 1)) ||
+		(writing && !soft->writable))
+	return NULL;
+#ifdef USE_TLB
+    totalcnt++;
+#endif
+    soft->entry->use = TRUE;
+    if (writing)
+	soft->entry->dirty = TRUE;
+    if (soft->tlbIndex >= 0)
+	tlbStamp[soft->tlbIndex] = ++tlbTicks;
+    return soft->host + (unsigned) virtAddr % PageSize;
+}
+
 extern void ExceptionHandler(ExceptionType which);
 				// Entry point into Nachos for handling
 				// user system calls and exceptions
@@ -37,6 +37,14 @@ Machine::Run()
 		   currentThread->getName(), stats->totalTicks);
 	interrupt->setStatus(UserMode);
 	for (;;) {
+		// The block engine runs straight-line code only, so a
+		// PC sitting in a branch delay slot, single stepping and
+		// instruction tracing all go through the interpreter.
+		if (BlockEngine && !singleStep && !HotDebugIsEnabled('m') &&
+				registers[NextPCReg] == registers[PCReg] + 4) {
+			interrupt->OneTick(RunBlock());
+			continue;
+		}
 		OneInstruction(instr);
 		interrupt->OneTick();
 		if (singleStep && (runUntilTime <= stats->totalTicks))
@@ -93,18 +101,11 @@ TypeToReg(RegType reg, Instruction *instr)
 void
 Machine::OneInstruction(Instruction *instr)
 {
-	int raw;
-	int nextLoadReg = 0; 	
-	int nextLoadValue = 0; 	// record delayed load operation, to apply
-				// in the future
-
 	// Fetch instruction 
-	if (!machine->ReadMem(registers[PCReg], 4, &raw))
+	if (!FetchInstruction(instr))
 		return;			// exception occurred
-	instr->value = raw;
-	instr->Decode();
 
-	if (DebugIsEnabled('m')) 
+	if (HotDebugIsEnabled('m')) 
 	{
 	   struct OpString *str = &opStrings[instr->opCode];
 
@@ -114,7 +115,27 @@ Machine::OneInstruction(Instruction *instr)
 		TypeToReg(str->args[1], instr), TypeToReg(str->args[2], instr));
 	   printf("\n");
 	}
-	
+
+	ExecuteInstruction(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::ExecuteInstruction
+// 	Execute one decoded instruction, apply any delayed load, and
+//	advance the program counters.  Shared by the interpreter
+//	(OneInstruction) and the basic-block engine (RunBlock).
+//
+//	Returns FALSE if the instruction raised an exception; the
+//	machine state is then left as the exception handler set it.
+//----------------------------------------------------------------------
+
+bool
+Machine::ExecuteInstruction(Instruction *instr)
+{
+	int nextLoadReg = 0; 	
+	int nextLoadValue = 0; 	// record delayed load operation, to apply
+				// in the future
+
 	// Compute next pc, but don't install in case there's an error or branch.
 	int pcAfter = registers[NextPCReg] + 4;
 	int sum, diff, tmp, value;
@@ -129,7 +150,7 @@ Machine::OneInstruction(Instruction *instr)
 					((registers[instr->rs] ^ sum) & SIGN_BIT)) 
 			{
 				RaiseException(OverflowException, 0);
-				return;
+				return FALSE;
 			}
 			registers[instr->rd] = sum;
 			break;
@@ -140,7 +161,7 @@ Machine::OneInstruction(Instruction *instr)
 					((instr->extra ^ sum) & SIGN_BIT)) 
 			{
 				RaiseException(OverflowException, 0);
-				return;
+				return FALSE;
 			}
 			registers[instr->rt] = sum;
 			break;
@@ -242,7 +263,7 @@ Machine::OneInstruction(Instruction *instr)
 	  	case OP_LBU:
 			tmp = registers[instr->rs] + instr->extra;
 			if (!machine->ReadMem(tmp, 1, &value))
-				return;
+				return FALSE;
 
 			if ((value & 0x80) && (instr->opCode == OP_LB))
 				value |= 0xffffff00;
@@ -258,10 +279,10 @@ Machine::OneInstruction(Instruction *instr)
 			if (tmp & 0x1) 
 			{
 				RaiseException(AddressErrorException, tmp);
-				return;
+				return FALSE;
 			}
 			if (!machine->ReadMem(tmp, 2, &value))
-				return;
+				return FALSE;
 
 			if ((value & 0x8000) && (instr->opCode == OP_LH))
 				value |= 0xffff0000;
@@ -272,7 +293,7 @@ Machine::OneInstruction(Instruction *instr)
 			break;
 	  	
 	 	case OP_LUI:
-			DEBUG('m', "Executing: LUI r%d,%d\n", instr->rt, instr->extra);
+			DEBUG_HOT('m', "Executing: LUI r%d,%d\n", instr->rt, instr->extra);
 			registers[instr->rt] = instr->extra << 16;
 			break;
 	
@@ -281,10 +302,10 @@ Machine::OneInstruction(Instruction *instr)
 			if (tmp & 0x3) 
 			{
 				RaiseException(AddressErrorException, tmp);
-				return;
+				return FALSE;
 			}
 			if (!machine->ReadMem(tmp, 4, &value))
-				return;
+				return FALSE;
 			nextLoadReg = instr->rt;
 			nextLoadValue = value;
 			break;
@@ -298,7 +319,7 @@ Machine::OneInstruction(Instruction *instr)
 			ASSERT((tmp & 0x3) == 0);  
 
 			if (!machine->ReadMem(tmp, 4, &value))
-				return;
+				return FALSE;
 			if (registers[LoadReg] == instr->rt)
 				nextLoadValue = registers[LoadValueReg];
 			else
@@ -330,7 +351,7 @@ Machine::OneInstruction(Instruction *instr)
 			ASSERT((tmp & 0x3) == 0);  
 
 			if (!machine->ReadMem(tmp, 4, &value))
-				return;
+				return FALSE;
 			if (registers[LoadReg] == instr->rt)
 				nextLoadValue = registers[LoadValueReg];
 			else
@@ -397,13 +418,13 @@ Machine::OneInstruction(Instruction *instr)
 	  	case OP_SB:
 			if (!machine->WriteMem((unsigned) 
 					(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
-				return;
+				return FALSE;
 			break;
 	
 	  	case OP_SH:
 			if (!machine->WriteMem((unsigned) 
 					(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
-				return;
+				return FALSE;
 			break;
 	
 	  	case OP_SLL:
@@ -474,7 +495,7 @@ Machine::OneInstruction(Instruction *instr)
 					((registers[instr->rs] ^ diff) & SIGN_BIT)) 
 			{
 				RaiseException(OverflowException, 0);
-				return;
+				return FALSE;
 			}
 			registers[instr->rd] = diff;
 			break;
@@ -486,7 +507,7 @@ Machine::OneInstruction(Instruction *instr)
 	  	case OP_SW:
 			if (!machine->WriteMem((unsigned) 
 					(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
-				return;
+				return FALSE;
 			break;
 	
 	  	case OP_SWL:	  
@@ -497,7 +518,7 @@ Machine::OneInstruction(Instruction *instr)
 			ASSERT((tmp & 0x3) == 0);  
 
 			if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-				return;
+				return FALSE;
 			switch (tmp & 0x3) 
 			{
 	  			case 0:
@@ -517,7 +538,7 @@ Machine::OneInstruction(Instruction *instr)
 					break;
 			}
 			if (!machine->WriteMem((tmp & ~0x3), 4, value))
-				return;
+				return FALSE;
 			break;
 		
 	  	case OP_SWR:	  
@@ -528,7 +549,7 @@ Machine::OneInstruction(Instruction *instr)
 			ASSERT((tmp & 0x3) == 0);  
 
 			if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-				return;
+				return FALSE;
 			switch (tmp & 0x3) 
 			{
 				case 0:
@@ -545,12 +566,12 @@ Machine::OneInstruction(Instruction *instr)
 				break;
 			}
 			if (!machine->WriteMem((tmp & ~0x3), 4, value))
-				return;
+				return FALSE;
 			break;
 		
 	  	case OP_SYSCALL:
 			RaiseException(SyscallException, 0);
-			return; 
+			return FALSE; 
 	
 	  	case OP_XOR:
 			registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
@@ -563,7 +584,7 @@ Machine::OneInstruction(Instruction *instr)
 	  	case OP_RES:
 	  	case OP_UNIMP:
 			RaiseException(IllegalInstrException, 0);
-			return;
+			return FALSE;
 	
 	  	default:
 			ASSERT(FALSE);
@@ -579,6 +600,174 @@ Machine::OneInstruction(Instruction *instr)
 						// are jumping into lala-land
 	registers[PCReg] = registers[NextPCReg];
 	registers[NextPCReg] = pcAfter;
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::FetchInstruction
+// 	Fetch the instruction at the current PC and decode it into "instr".
+//
+//	The PC is still translated on every fetch, so the TLB (and its
+//	miss statistics) sees exactly the references it did before.  What
+//	we skip is the memory read and Instruction::Decode: the decoded
+//	form of every word we execute is cached by physical address, and
+//	reused until the word is stored to (see WriteMem) or the kernel
+//	loads a new page into the frame (see InvalidateFrame).
+//
+//	Returns FALSE if the translation failed; the exception has then
+//	already been raised, as ReadMem would have done.
+//----------------------------------------------------------------------
+
+bool
+Machine::FetchInstruction(Instruction *instr)
+{
+	int physAddr;
+
+	if (!TranslatePC(&physAddr))
+		return FALSE;
+	*instr = *Predecode(physAddr);
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::TranslatePC
+// 	Translate the PC for an instruction fetch, through the software
+//	TLB when we can.  On failure, raise the exception (counting a TLB
+//	miss, as ReadMem does) and return FALSE.
+//----------------------------------------------------------------------
+
+bool
+Machine::TranslatePC(int *physAddr)
+{
+	ExceptionType exception;
+	char *host;
+
+	if ((host = SoftTranslate(registers[PCReg], 4, FALSE)) != NULL) {
+		*physAddr = host - mainMemory;
+		return TRUE;
+	}
+	exception = Translate(registers[PCReg], physAddr, 4, FALSE);
+	if (exception != NoException) {
+#ifdef USE_TLB
+		misscnt++;
+#endif
+		RaiseException(exception, registers[PCReg]);
+		return FALSE;
+	}
+	FillSoftTLB(registers[PCReg]);
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::Predecode
+// 	Return the decoded instruction stored at "physAddr", decoding
+//	it and filling its predecode slot if it is not cached yet.
+//----------------------------------------------------------------------
+
+Instruction *
+Machine::Predecode(int physAddr)
+{
+	int slot = physAddr / 4;
+
+	if (decodeValid[slot]) {
+		stats->numDecodeHits++;
+	} else {
+		decodeCache[slot].value =
+			WordToHost(*(unsigned int *) &mainMemory[physAddr]);
+		decodeCache[slot].Decode();
+		decodeValid[slot] = TRUE;
+		stats->numDecodeMisses++;
+	}
+	return &decodeCache[slot];
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	Execute the basic block starting at the current PC, translating
+//	it first if it is not in the block cache.
+//
+//	Only the first instruction's address goes through Translate; the
+//	rest of the block is on the same page, so it cannot fault, and we
+//	run its micro-ops back to back without fetching.  We stop early
+//	if an instruction traps (the kernel may have changed anything),
+//	or if a store rewrote code in the block's own page.
+//
+//	Returns the number of instructions to charge to the clock,
+//	counting a trapping instruction, as OneInstruction does.
+//----------------------------------------------------------------------
+
+int
+Machine::RunBlock()
+{
+	int physAddr;
+
+	if (!TranslatePC(&physAddr))
+		return 1;
+
+	int frame = physAddr / PageSize;
+	BasicBlock *block = &blockCache[(physAddr / 4) & (BlockCacheSize - 1)];
+	if (block->physAddr != physAddr || block->gen != frameGen[frame]) {
+		TranslateBlock(block, physAddr);
+		stats->numBlockMisses++;
+	} else
+		stats->numBlockHits++;
+
+	for (int i = 0; i < block->length; i++) {
+		if (!ExecuteInstruction(&block->ops[i]) ||
+				block->gen != frameGen[frame]) {
+			stats->numBlockInstrs += i + 1;
+			return i + 1;
+		}
+	}
+	stats->numBlockInstrs += block->length;
+	return block->length;
+}
+
+//----------------------------------------------------------------------
+// Machine::TranslateBlock
+// 	Build the micro-ops for the basic block starting at "physAddr"
+//	into "block".  The block runs up to and including the delay slot
+//	of the first branch or jump, stops after an instruction that
+//	always traps, and never crosses the end of the page (the next
+//	page need not be mapped to the next frame).
+//----------------------------------------------------------------------
+
+void
+Machine::TranslateBlock(BasicBlock *block, int physAddr)
+{
+	int end = (physAddr / PageSize + 1) * PageSize;
+	bool inDelaySlot = FALSE;
+	int n = 0;
+
+	for (int addr = physAddr; addr < end && n < MaxBlockLength; addr += 4) {
+		Instruction *instr = Predecode(addr);
+
+		block->ops[n++] = *instr;
+		if (inDelaySlot)
+			break;
+		switch (instr->opCode) {
+		  	case OP_BEQ:	case OP_BNE:
+		  	case OP_BGEZ:	case OP_BGEZAL:
+		  	case OP_BGTZ:	case OP_BLEZ:
+		  	case OP_BLTZ:	case OP_BLTZAL:
+		  	case OP_J:	case OP_JAL:
+		  	case OP_JR:	case OP_JALR:
+				inDelaySlot = TRUE;
+				continue;
+
+		  	case OP_SYSCALL:
+		  	case OP_RES:
+		  	case OP_UNIMP:
+				break;
+
+		  	default:
+				continue;
+		}
+		break;
+	}
+	block->physAddr = physAddr;
+	block->gen = frameGen[physAddr / PageSize];
+	block->length = n;
 }
 
 //----------------------------------------------------------------------
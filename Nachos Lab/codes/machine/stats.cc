@@ -10,6 +10,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "stats.h"
+#include "translate.h"
 
 //----------------------------------------------------------------------
 // Statistics::Statistics
@@ -22,6 +23,15 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numPagingReads = numPagingWrites = 0;
+    numZeroFillFaults = 0;
+    numPrefetched = numPrefetchHits = 0;
+    numPagerWrites = numPagerFrees = 0;
+    numASIDRecycles = 0;
+    numSwapOuts = numSwappedPages = 0;
+    numDecodeHits = numDecodeMisses = 0;
+    numBlockHits = numBlockMisses = numBlockInstrs = 0;
+    hostStartTime = HostCPUTime();
 }
 
 //----------------------------------------------------------------------
@@ -38,7 +48,42 @@ Statistics::Print()
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
-    printf("Paging: faults %d\n", numPageFaults);
+    printf("Paging: faults %d (zero-fill %d, from disk %d)\n", numPageFaults,
+	numZeroFillFaults, numPageFaults - numZeroFillFaults);
+    if (numPageFaults > 0)
+	printf("Paging I/O: disk reads %d (%.2f per fault), writes %d\n",
+	    numPagingReads, (double) numPagingReads / numPageFaults,
+	    numPagingWrites);
+    if (numPrefetched > 0)
+	printf("Read-ahead: pages %d, referenced %d (%.2f%%)\n",
+	    numPrefetched, numPrefetchHits,
+	    100.0 * numPrefetchHits / numPrefetched);
+    if (numSwapOuts > 0)
+	printf("Working sets: processes swapped out %d, frames freed %d\n",
+	    numSwapOuts, numSwappedPages);
+#ifdef USE_TLB
+    if (totalcnt > 0)		// as TLBMissRate counts them
+	printf("TLB: references %d, misses %d (%.2f%%), address space IDs recycled %d\n",
+	    totalcnt - misscnt, misscnt, 100.0 * misscnt / (totalcnt - misscnt),
+	    numASIDRecycles);
+#endif
+    if (numPagerFrees > 0)
+	printf("Pager: frames freed %d, pages cleaned %d, writebacks in faults %d\n",
+	    numPagerFrees, numPagerWrites, numPagingWrites - numPagerWrites);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
+    if (numDecodeHits + numDecodeMisses > 0)
+	printf("Decode cache: hits %d, misses %d, hit rate %.2f%%\n",
+	    numDecodeHits, numDecodeMisses,
+	    100.0 * numDecodeHits / (numDecodeHits + numDecodeMisses));
+    if (numBlockHits + numBlockMisses > 0)
+	printf("Block cache: hits %d, translations %d, avg block %.2f instrs\n",
+	    numBlockHits, numBlockMisses,
+	    (double) numBlockInstrs / (numBlockHits + numBlockMisses));
+
+    double hostTime = HostCPUTime() - hostStartTime;
+    if (userTicks > 0 && hostTime > 0)
+	printf("Simulation speed: %d user instructions in %.3f host CPU "
+	    "seconds, %.0f instructions/sec\n", userTicks / UserTick,
+	    hostTime, userTicks / UserTick / hostTime);
 }
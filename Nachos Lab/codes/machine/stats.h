@@ -33,8 +33,29 @@ class Statistics {
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numPagingReads;		// disk reads and writes done for page
+    int numPagingWrites;	// faults and evictions
+    int numZeroFillFaults;	// page faults served by zeroing a frame,
+				// without any disk I/O
+    int numPrefetched;		// pages read ahead of a fault, and how
+    int numPrefetchHits;	// many of them were then referenced
+    int numPagerWrites;		// dirty pages the pager wrote back, and
+    int numPagerFrees;		// frames it freed, ahead of page faults
+    int numSwapOuts;		// processes swapped out whole, since the
+				// working sets did not fit in memory
+    int numSwappedPages;	// frames those swap-outs freed
+    int numASIDRecycles;	// address space IDs taken back for reuse,
+				// each flushing that ID's TLB entries
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numDecodeHits;		// instruction fetches served by the
+    int numDecodeMisses;	// predecoded instruction cache, and
+				// fetches that had to decode
+    int numBlockHits;		// basic blocks run from the block cache,
+    int numBlockMisses;		// blocks that had to be translated first,
+    int numBlockInstrs;		// and instructions executed inside blocks
+    double hostStartTime;	// host CPU time when Nachos started, to
+				// report the simulator's own speed
 
     Statistics(); 		// initialize everything to zero
 
@@ -35,6 +35,7 @@ extern "C" {
 #include <sys/file.h>
 #include <sys/un.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #ifdef HOST_i386
 #include <unistd.h>
 #include <sys/time.h>
@@ -416,6 +417,38 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// HostCPUTime
+// 	Return the user plus system CPU time the UNIX process running
+//	Nachos has used so far, in seconds.  Used to report how fast
+//	the simulation itself runs.
+//----------------------------------------------------------------------
+
+double
+HostCPUTime()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+	+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+//----------------------------------------------------------------------
+// HostWallTime
+// 	Return the host's wall clock time, in seconds.  Only differences
+//	between two calls are meaningful.
+//----------------------------------------------------------------------
+
+double
+HostWallTime()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -43,6 +43,11 @@ extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
 
+// CPU time used by the Nachos process so far, and the host's wall
+// clock time, in seconds
+extern double HostCPUTime();
+extern double HostWallTime();
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
 
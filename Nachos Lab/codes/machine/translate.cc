@@ -77,11 +77,59 @@ unsigned short
 ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
 
 
+//----------------------------------------------------------------------
+// ReadHost, WriteHost
+// 	Read or write "size" (1, 2, or 4) bytes of simulated memory that
+//	has already been translated to "host", a pointer into mainMemory,
+//	converting between host and machine byte order.
+//----------------------------------------------------------------------
+
+static int
+ReadHost(char *host, int size)
+{
+    switch (size) {
+      case 1:
+	return *host;
+
+      case 2:
+	return ShortToHost(*(unsigned short *) host);
+
+      case 4:
+	return WordToHost(*(unsigned int *) host);
+
+      default: ASSERT(FALSE);
+    }
+    return 0;
+}
+
+static void
+WriteHost(char *host, int size, int value)
+{
+    switch (size) {
+      case 1:
+	*host = (unsigned char) (value & 0xff);
+	break;
+
+      case 2:
+	*(unsigned short *) host = ShortToMachine((unsigned short) (value & 0xffff));
+	break;
+      
+      case 4:
+	*(unsigned int *) host = WordToMachine((unsigned int) value);
+	break;
+	
+      default: ASSERT(FALSE);
+    }
+}
+
 //----------------------------------------------------------------------
 // Machine::ReadMem
 //      Read "size" (1, 2, or 4) bytes of virtual memory at "addr" into 
 //	the location pointed to by "value".
 //
+//	The software TLB is tried first; only on a miss do we go through
+//	Translate, and then remember its answer for next time.
+//
 //   	Returns FALSE if the translation step from virtual to physical memory
 //   	failed.
 //
@@ -93,11 +141,16 @@ ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
 bool
 Machine::ReadMem(int addr, int size, int *value)
 {
-    int data;
     ExceptionType exception;
     int physicalAddress;
+    char *host;
     
-    DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
+    if ((host = SoftTranslate(addr, size, FALSE)) != NULL) {
+	*value = ReadHost(host, size);
+	return TRUE;
+    }
+
+    DEBUG_HOT('a', "Reading VA 0x%x, size %d\n", addr, size);
     
     exception = Translate(addr, &physicalAddress, size, FALSE);
     if (exception != NoException) {
@@ -107,26 +160,10 @@ Machine::ReadMem(int addr, int size, int *value)
 		machine->RaiseException(exception, addr);
 		return FALSE;
     }
-    switch (size) {
-      	case 1:
-			data = machine->mainMemory[physicalAddress];
-			*value = data;
-			break;
-	
-      	case 2:
-			data = *(unsigned short *) &machine->mainMemory[physicalAddress];
-			*value = ShortToHost(data);
-			break;
-	
-      	case 4:
-			data = *(unsigned int *) &machine->mainMemory[physicalAddress];
-			*value = WordToHost(data);
-			break;
-
-      	default: ASSERT(FALSE);
-    }
+    FillSoftTLB(addr);
+    *value = ReadHost(&machine->mainMemory[physicalAddress], size);
     
-    DEBUG('a', "\tvalue read = %8.8x\n", *value);
+    DEBUG_HOT('a', "\tvalue read = %8.8x\n", *value);
     return (TRUE);
 }
 
@@ -135,6 +172,8 @@ Machine::ReadMem(int addr, int size, int *value)
 //      Write "size" (1, 2, or 4) bytes of the contents of "value" into
 //	virtual memory at location "addr".
 //
+//	As in ReadMem, the software TLB is tried before Translate.
+//
 //   	Returns FALSE if the translation step from virtual to physical memory
 //   	failed.
 //
@@ -148,38 +187,120 @@ Machine::WriteMem(int addr, int size, int value)
 {
     ExceptionType exception;
     int physicalAddress;
+    char *host;
      
-    DEBUG('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
+    if ((host = SoftTranslate(addr, size, TRUE)) != NULL) {
+	physicalAddress = host - mainMemory;
+    } else {
+	DEBUG_HOT('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
 
-    exception = Translate(addr, &physicalAddress, size, TRUE);
-    if (exception != NoException) {
+	exception = Translate(addr, &physicalAddress, size, TRUE);
+	if (exception != NoException) {
 #ifdef USE_TLB
-    misscnt++;
+	    misscnt++;
 #endif
-	machine->RaiseException(exception, addr);
-	return FALSE;
+	    machine->RaiseException(exception, addr);
+	    return FALSE;
+	}
+	FillSoftTLB(addr);
     }
-    switch (size) {
-      case 1:
-	machine->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
-	break;
-
-      case 2:
-	*(unsigned short *) &machine->mainMemory[physicalAddress]
-		= ShortToMachine((unsigned short) (value & 0xffff));
-	break;
-      
-      case 4:
-	*(unsigned int *) &machine->mainMemory[physicalAddress]
-		= WordToMachine((unsigned int) value);
-	break;
-	
-      default: ASSERT(FALSE);
+    if (decodeValid[physicalAddress / 4]) {	// storing over code: forget
+	decodeValid[physicalAddress / 4] = FALSE;	// its decoding, and any
+	frameGen[physicalAddress / PageSize]++;	// blocks built from it
     }
-    
+    WriteHost(&machine->mainMemory[physicalAddress], size, value);
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::FillSoftTLB
+// 	Cache the translation of "virtAddr" that Translate has just
+//	checked (it left the entry it used in "lastEntry").
+//
+//	When address tracing ('a') is on we cache nothing, so that every
+//	access still goes through Translate and shows up in the trace.
+//----------------------------------------------------------------------
+
+void
+Machine::FillSoftTLB(int virtAddr)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    SoftTLBEntry *soft = &softTLB[vpn & (SoftTLBSize - 1)];
+
+    if (HotDebugIsEnabled('a'))
+	return;
+    soft->vpn = vpn;
+    soft->host = &mainMemory[lastEntry->physicalPage * PageSize];
+    soft->writable = !lastEntry->readOnly;
+    soft->entry = lastEntry;
+    if (tlb != NULL && lastEntry >= tlb && lastEntry < tlb + tlbSize)
+	soft->tlbIndex = lastEntry - tlb;
+    else
+	soft->tlbIndex = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushSoftTLB
+// 	Invalidate the whole software TLB.  Its entries point at TLB and
+//	page table entries, so this must be called whenever the kernel
+//	gets a chance to change those: on every exception (see
+//	RaiseException) and on every address space switch (see
+//	AddrSpace::SaveState and RestoreState).
+//----------------------------------------------------------------------
+
+void
+Machine::FlushSoftTLB()
+{
+    for (int i = 0; i < SoftTLBSize; i++)
+	softTLB[i].vpn = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::SyncTLB
+// 	The TLB holds copies of page table entries, so the use and dirty
+//	bits Translate sets land in the copies.  OR them back into the
+//	page tables, so page replacement sees which pages were referenced
+//	and which must be written back.  Entries are tagged with address
+//	space IDs and outlive context switches, so each goes back to the
+//	page table of its own ID.  Called before a TLB entry is replaced
+//	or flushed, and before choosing a victim page.
+//----------------------------------------------------------------------
+
+void
+Machine::SyncTLB()
+{
+#if defined(USE_TLB) && !defined(INVERTED_PAGETABLE)
+    for (int i = 0; i < tlbSize; i++) {
+	if (!tlb[i].valid)
+	    continue;
+	TranslationEntry *table = asidPageTable[tlb[i].asid];
+	if (table != NULL && (unsigned) tlb[i].virtualPage < asidPageTableSize[tlb[i].asid]) {
+	    TranslationEntry *entry = &table[tlb[i].virtualPage];
+	    entry->use = entry->use || tlb[i].use;
+	    entry->dirty = entry->dirty || tlb[i].dirty;
+	}
+    }
+#endif
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTLB
+// 	Drop every TLB entry tagged "asid", after saving their use and
+//	dirty bits: the ID is being given to another address space, or
+//	its page table has changed under the TLB.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushTLB(int asid)
+{
+#ifdef USE_TLB
+    SyncTLB();
+    for (int i = 0; i < tlbSize; i++)
+	if (tlb[i].asid == asid)
+	    tlb[i].valid = FALSE;
+#endif
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using 
@@ -207,11 +328,11 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     totalcnt++;
 #endif
 
-    DEBUG('a', "\tTranslate 0x%x, %s: ", virtAddr, writing ? "write" : "read");
+    DEBUG_HOT('a', "\tTranslate 0x%x, %s: ", virtAddr, writing ? "write" : "read");
 
 // check for alignment errors
     if (((size == 4) && (virtAddr & 0x3)) || ((size == 2) && (virtAddr & 0x1))){
-	DEBUG('a', "alignment problem at %d, size %d!\n", virtAddr, size);
+	DEBUG_HOT('a', "alignment problem at %d, size %d!\n", virtAddr, size);
 	return AddressErrorException;
     }
     
@@ -227,23 +348,26 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 #ifndef INVERTED_PAGETABLE
     if (tlb == NULL) {		// => page table => vpn is index into table
 	if (vpn >= pageTableSize) {
-	    DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
+	    DEBUG_HOT('a', "virtual page # %d too large for page table size %d!\n", 
 			virtAddr, pageTableSize);
 	    return AddressErrorException;
 	} else if (!pageTable[vpn].valid) {
-	    DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
+	    DEBUG_HOT('a', "virtual page # %d too large for page table size %d!\n", 
 			virtAddr, pageTableSize);
 	    return PageFaultException;
 	}
 	entry = &pageTable[vpn];
     } else {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
-    	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)) {
+	int set = TLBSet(vpn);			// only its set can hold it
+        for (entry = NULL, i = set; i < set + tlbWays; i++)
+    	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)
+		    && (tlb[i].asid == currentASID)) {
 		entry = &tlb[i];			// FOUND!
+		tlbStamp[i] = ++tlbTicks;		// for LRU replacement
 		break;
 	    }
 	if (entry == NULL) {				// not found
-    	    DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
+    	    DEBUG_HOT('a', "*** no valid TLB entry found for this virtual page!\n");
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
 						// but not in the TLB
@@ -255,28 +379,19 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     {
         if (vpn >= pageTableSize) 
         {
-	    DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
+	    DEBUG_HOT('a', "virtual page # %d too large for page table size %d!\n", 
 			virtAddr, pageTableSize);
 	    return AddressErrorException;
 	}
 	
-	int pos = -1;
-	for(int tmppos=0; tmppos<pageTableSize; ++tmppos)
-	{
-	    if(pageTable[tmppos].valid && pageTable[tmppos].virtualPage==vpn 
-	        && pageTable[tmppos].TID == currentThread->getTID())
-	    {
-                pos = tmppos;
-	        break;
-	    }
-	}
+	int pos = LookupFrame(currentThread->getTID(), vpn);
 	if(pos == -1)
 	    return PageFaultException;
 	entry = &pageTable[pos];
     } 
     else 
     {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
+        for (entry = NULL, i = 0; i < tlbSize; i++)
     	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)) 
     	    {
 		entry = &tlb[i];			// FOUND!
@@ -284,7 +399,7 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	    }
 	if (entry == NULL)                              // not found
 	{				
-    	    DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
+    	    DEBUG_HOT('a', "*** no valid TLB entry found for this virtual page!\n");
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
 						// but not in the TLB
@@ -293,22 +408,23 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 #endif
 
     if (entry->readOnly && writing) {	// trying to write to a read-only page
-	DEBUG('a', "%d mapped read-only at %d in TLB!\n", virtAddr, i);
+	DEBUG_HOT('a', "%d mapped read-only at %d in TLB!\n", virtAddr, i);
 	return ReadOnlyException;
     }
     pageFrame = entry->physicalPage;
 
     // if the pageFrame is too big, there is something really wrong! 
     // An invalid translation was loaded into the page table or TLB. 
-    if (pageFrame >= NumPhysPages) { 
-	DEBUG('a', "*** frame %d > %d!\n", pageFrame, NumPhysPages);
+    if (pageFrame >= (unsigned) numPhysPages) { 
+	DEBUG_HOT('a', "*** frame %d > %d!\n", pageFrame, numPhysPages);
 	return BusErrorException;
     }
     entry->use = TRUE;		// set the use, dirty bits
     if (writing)
 	entry->dirty = TRUE;
+    lastEntry = entry;		// for FillSoftTLB
     *physAddr = pageFrame * PageSize + offset;
-    ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
-    DEBUG('a', "phys addr = 0x%x\n", *physAddr);
+    ASSERT((*physAddr >= 0) && ((*physAddr + size) <= numPhysPages * PageSize));
+    DEBUG_HOT('a', "phys addr = 0x%x\n", *physAddr);
     return NoException;
 }
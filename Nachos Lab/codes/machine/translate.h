@@ -46,6 +46,9 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    int asid;		// In a TLB entry, the address space ID of the
+			// address space it translates for; a TLB entry
+			// is only used while its ID is the current one.
 
 #ifdef INVERTED_PAGETABLE
     int TID;
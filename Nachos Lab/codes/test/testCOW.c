@@ -0,0 +1,44 @@
+#include "syscall.h"
+
+#define NumPages 4
+#define PageInts 32
+
+int value;
+int pages[NumPages * PageInts];
+
+void check(int own)
+{
+    int i;
+
+    if (value != 0)
+        Exit(-1);
+    for (i = 0; i < NumPages * PageInts; i += PageInts)
+        if (pages[i] != 0)
+            Exit(-1);
+
+    value = own;
+    for (i = 0; i < NumPages * PageInts; i += PageInts)
+        pages[i] = own;
+    Yield();
+
+    for (i = 0; i < NumPages * PageInts; i += PageInts)
+        if (pages[i] != own)
+            Exit(-1);
+    Exit(value);
+}
+
+void func()
+{
+    check(2);
+}
+
+void main()
+{
+    int i;
+
+    value = 0;
+    for (i = 0; i < NumPages * PageInts; i += PageInts)
+        pages[i] = 0;
+    Fork(func);
+    check(1);
+}
@@ -68,4 +68,102 @@ class List {
     int numInList;		// number of elements in list
 };
 
+// The following template defines an "intrusive" list of T's: rather
+// than allocating a ListElement for each item, it chains the items
+// through a "listNext" field and sorts on a "listKey" field that
+// every T carries itself.  An item can thus be on only one such list
+// at a time, but putting it on or taking it off never touches the
+// heap.  The scheduler's ready queues and the semaphore and condition
+// wait queues keep Threads this way.
+
+template <class T>
+class IntrusiveList {
+  public:
+    IntrusiveList() { first = last = NULL; numInList = 0; }
+
+    void Prepend(T *item);	// Put item at the beginning of the list
+    void Append(T *item);	// Put item at the end of the list
+    T *Remove();		// Take item off the front of the list,
+				// NULL if the list is empty
+
+    void Mapcar(VoidFunctionPtr func);	// Apply "func" to every item
+    unsigned int NumInList() { return numInList; }
+    bool IsEmpty() { return first == NULL; }
+
+    void SortedInsert(T *item, int sortKey);	// Put item after every 
+						// item with key <= sortKey
+
+  private:
+    T *first;			// Head of the list, NULL if list is empty
+    T *last;			// Last item of list
+    int numInList;		// number of items in list
+};
+
+template <class T>
+void
+IntrusiveList<T>::Prepend(T *item)
+{
+    item->listNext = first;
+    first = item;
+    if (last == NULL)
+	last = item;
+    numInList++;
+}
+
+template <class T>
+void
+IntrusiveList<T>::Append(T *item)
+{
+    item->listNext = NULL;
+    if (last == NULL)
+	first = item;
+    else
+	last->listNext = item;
+    last = item;
+    numInList++;
+}
+
+template <class T>
+T *
+IntrusiveList<T>::Remove()
+{
+    T *item = first;
+
+    if (item == NULL)
+	return NULL;
+    first = item->listNext;
+    if (first == NULL)
+	last = NULL;
+    item->listNext = NULL;
+    numInList--;
+    return item;
+}
+
+template <class T>
+void
+IntrusiveList<T>::Mapcar(VoidFunctionPtr func)
+{
+    for (T *item = first; item != NULL; item = item->listNext)
+	(*func)((int)item);
+}
+
+template <class T>
+void
+IntrusiveList<T>::SortedInsert(T *item, int sortKey)
+{
+    item->listKey = sortKey;
+    if (first == NULL || sortKey < first->listKey) {
+	Prepend(item);
+	return;
+    }
+    T *ptr = first;			// find the last item with key <= sortKey
+    while (ptr->listNext != NULL && !(sortKey < ptr->listNext->listKey))
+	ptr = ptr->listNext;
+    item->listNext = ptr->listNext;
+    ptr->listNext = item;
+    if (ptr == last)
+	last = item;
+    numInList++;
+}
+
 #endif // LIST_H
@@ -8,8 +8,11 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
+// Usage: nachos -d <debugflags> -rs <random seed #> -rr -mlfq -cfs
+//		-s -bb -ra <pages> -mem <frames> -tlbsize <entries> -tlbways <ways>
+//		-tlbpolicy <fifo|clock|lru|random>
+//		-x <nachos file> -c <consoleIn> <consoleOut>
+//		-bench <runs>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
@@ -18,11 +21,28 @@
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -rr schedules threads round robin on a timer
+//    -mlfq schedules threads with a multi-level feedback queue; a
+//	thread's priority picks its starting level
+//    -cfs schedules threads by least weighted virtual runtime; a
+//	thread's priority (-20 .. 19) sets its weight
 //    -z prints the copyright message
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -bb runs user programs on the basic-block engine instead of
+//	the one-instruction-at-a-time interpreter
+//    -ra caps how many pages a page fault reads ahead when a program
+//	faults sequentially (default 4, at most 32, 0 turns read-ahead
+//	off)
+//    -mem sets the size of physical memory, in frames (default 32)
+//    -tlbsize, -tlbways and -tlbpolicy set the number of TLB entries
+//	(default 4), the entries in each set (default all of them, i.e.
+//	fully associative), and how a TLB miss picks the entry to replace
+//	within the set (default fifo)
 //    -x runs a user program
+//    -bench runs matmult, sort and arrayAdd the given number of times
+//	and prints the simulator's speed on each run as CSV
 //    -c tests the console
 //
 //  FILESYS
@@ -63,6 +83,7 @@ extern void ThreadTest(void), Copy(char *unixFile, char *nachosFile);
 extern void Print(char *file), PerformanceTest(void);
 extern void StartProcess(char *file), ConsoleTest(char *in, char *out), SynchConsoleTest(char *in, char *out);
 extern void StartNProcesses(char *filename);
+extern void Benchmark(int runs);
 extern void MailTest(int networkID);
 extern void MakeDir(char *dirname);
 extern void ConcurrencyTest(), ConcurrencyTest1(), PipeTest();
@@ -135,6 +156,11 @@ main(int argc, char **argv)
 			StartNProcesses(*(argv + 1));
 			argCount = 2;
 		}
+		else if (!strcmp(*argv, "-bench")) {	// simulator benchmark
+			ASSERT(argc > 1);
+			Benchmark(atoi(*(argv + 1)));
+			argCount = 2;
+		}
 		else if (!strcmp(*argv, "-c")) {      // test the console
 			if (argc == 1)
 				ConsoleTest(NULL, NULL);
@@ -0,0 +1,319 @@
+// rbtree.h
+//	Data structures to manage a red-black tree -- a balanced binary
+//	search tree, so that inserting or removing an item takes
+//	O(log n) steps and the smallest item is always at hand.
+//
+//	Like IntrusiveList (list.h), the tree keeps no storage of its
+//	own: every item T carries its links ("rbLeft", "rbRight",
+//	"rbParent") and color ("rbRed"), so an item can be in only one
+//	tree at a time.  Items are ordered by the function "Before",
+//	which must be a strict total order: equal keys need a tie-break.
+//
+//	The CFS scheduler keeps its ready threads in such a tree,
+//	ordered by virtual runtime.
+
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include "utility.h"
+
+template <class T, bool (*Before)(T *, T *)>
+class RBTree {
+  public:
+    RBTree() { root = leftmost = NULL; numInTree = 0; }
+
+    void Insert(T *item);		// Put item into the tree
+    void Remove(T *item);		// Take item (which must be in the
+					// tree) out of the tree
+    T *First() { return leftmost; }	// Smallest item, NULL if empty
+
+    void Mapcar(VoidFunctionPtr func);	// Apply "func" to every item,
+					// smallest first
+    unsigned int NumInTree() { return numInTree; }
+    bool IsEmpty() { return root == NULL; }
+
+  private:
+    T *root;			// NULL if the tree is empty
+    T *leftmost;		// smallest item, cached for First()
+    int numInTree;		// number of items in tree
+
+    static T *Next(T *item);	// item after "item" in order, or NULL
+    void Replace(T *item, T *by);	// hang "by" where "item" hung
+    void RotateLeft(T *item);
+    void RotateRight(T *item);
+    void InsertFixup(T *item);	// restore the red-black properties
+    void RemoveFixup(T *item, T *parent);
+};
+
+//----------------------------------------------------------------------
+// RBTree::Next
+// 	Return the item that follows "item" in order: the leftmost
+//	item of its right subtree, or else the first ancestor it is
+//	in the left subtree of.
+//----------------------------------------------------------------------
+
+template <class T, bool (*Before)(T *, T *)>
+T *
+RBTree<T, Before>::Next(T *item)
+{
+    if (item->rbRight != NULL) {
+	item = item->rbRight;
+	while (item->rbLeft != NULL)
+	    item = item->rbLeft;
+	return item;
+    }
+    while (item->rbParent != NULL && item == item->rbParent->rbRight)
+	item = item->rbParent;
+    return item->rbParent;
+}
+
+template <class T, bool (*Before)(T *, T *)>
+void
+RBTree<T, Before>::Replace(T *item, T *by)
+{
+    T *parent = item->rbParent;
+
+    if (parent == NULL)
+	root = by;
+    else if (item == parent->rbLeft)
+	parent->rbLeft = by;
+    else
+	parent->rbRight = by;
+    if (by != NULL)
+	by->rbParent = parent;
+}
+
+template <class T, bool (*Before)(T *, T *)>
+void
+RBTree<T, Before>::RotateLeft(T *item)
+{
+    T *right = item->rbRight;
+
+    item->rbRight = right->rbLeft;
+    if (right->rbLeft != NULL)
+	right->rbLeft->rbParent = item;
+    Replace(item, right);
+    right->rbLeft = item;
+    item->rbParent = right;
+}
+
+template <class T, bool (*Before)(T *, T *)>
+void
+RBTree<T, Before>::RotateRight(T *item)
+{
+    T *left = item->rbLeft;
+
+    item->rbLeft = left->rbRight;
+    if (left->rbRight != NULL)
+	left->rbRight->rbParent = item;
+    Replace(item, left);
+    left->rbRight = item;
+    item->rbParent = left;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Insert
+// 	Hang "item" as a red leaf where the search for it ends, then
+//	recolor and rotate on the way up until no red item has a red
+//	parent.  Items equal under Before go after the ones already
+//	there.
+//----------------------------------------------------------------------
+
+template <class T, bool (*Before)(T *, T *)>
+void
+RBTree<T, Before>::Insert(T *item)
+{
+    T *parent = NULL;
+    T **link = &root;
+    bool isLeftmost = TRUE;
+
+    while (*link != NULL) {
+	parent = *link;
+	if (Before(item, parent))
+	    link = &parent->rbLeft;
+	else {
+	    link = &parent->rbRight;
+	    isLeftmost = FALSE;
+	}
+    }
+    item->rbLeft = item->rbRight = NULL;
+    item->rbParent = parent;
+    item->rbRed = TRUE;
+    *link = item;
+    if (isLeftmost)
+	leftmost = item;
+    InsertFixup(item);
+    numInTree++;
+}
+
+template <class T, bool (*Before)(T *, T *)>
+void
+RBTree<T, Before>::InsertFixup(T *item)
+{
+    while (item->rbParent != NULL && item->rbParent->rbRed) {
+	T *parent = item->rbParent;
+	T *grand = parent->rbParent;	// exists: the root is black
+
+	if (parent == grand->rbLeft) {
+	    T *uncle = grand->rbRight;
+	    if (uncle != NULL && uncle->rbRed) {
+		parent->rbRed = uncle->rbRed = FALSE;
+		grand->rbRed = TRUE;
+		item = grand;
+		continue;
+	    }
+	    if (item == parent->rbRight) {	// turn it into the outer case
+		RotateLeft(parent);
+		item = parent;
+		parent = item->rbParent;
+	    }
+	    parent->rbRed = FALSE;
+	    grand->rbRed = TRUE;
+	    RotateRight(grand);
+	} else {
+	    T *uncle = grand->rbLeft;
+	    if (uncle != NULL && uncle->rbRed) {
+		parent->rbRed = uncle->rbRed = FALSE;
+		grand->rbRed = TRUE;
+		item = grand;
+		continue;
+	    }
+	    if (item == parent->rbLeft) {	// turn it into the outer case
+		RotateRight(parent);
+		item = parent;
+		parent = item->rbParent;
+	    }
+	    parent->rbRed = FALSE;
+	    grand->rbRed = TRUE;
+	    RotateLeft(grand);
+	}
+    }
+    root->rbRed = FALSE;
+}
+
+//----------------------------------------------------------------------
+// RBTree::Remove
+// 	Unlink "item".  An item with two children is replaced by its
+//	successor, which has at most one.  If the item that actually
+//	left its place was black, one path is now a black short, and
+//	RemoveFixup mends that.
+//----------------------------------------------------------------------
+
+template <class T, bool (*Before)(T *, T *)>
+void
+RBTree<T, Before>::Remove(T *item)
+{
+    T *child;			// what moved into the vacated place
+    T *parent;			// child's parent (child may be NULL)
+    bool removedRed;
+
+    if (item == leftmost)
+	leftmost = Next(item);
+
+    if (item->rbLeft != NULL && item->rbRight != NULL) {
+	T *next = item->rbRight;
+	while (next->rbLeft != NULL)
+	    next = next->rbLeft;
+
+	child = next->rbRight;
+	removedRed = next->rbRed;
+	if (next->rbParent == item)
+	    parent = next;
+	else {
+	    parent = next->rbParent;
+	    parent->rbLeft = child;
+	    if (child != NULL)
+		child->rbParent = parent;
+	    next->rbRight = item->rbRight;
+	    item->rbRight->rbParent = next;
+	}
+	Replace(item, next);
+	next->rbLeft = item->rbLeft;
+	item->rbLeft->rbParent = next;
+	next->rbRed = item->rbRed;
+    } else {
+	child = (item->rbLeft != NULL) ? item->rbLeft : item->rbRight;
+	parent = item->rbParent;
+	removedRed = item->rbRed;
+	Replace(item, child);
+    }
+    item->rbLeft = item->rbRight = item->rbParent = NULL;
+
+    if (!removedRed)
+	RemoveFixup(child, parent);
+    numInTree--;
+}
+
+template <class T, bool (*Before)(T *, T *)>
+void
+RBTree<T, Before>::RemoveFixup(T *item, T *parent)
+{
+    while (item != root && (item == NULL || !item->rbRed)) {
+	if (item == parent->rbLeft) {
+	    T *sibling = parent->rbRight;
+	    if (sibling->rbRed) {
+		sibling->rbRed = FALSE;
+		parent->rbRed = TRUE;
+		RotateLeft(parent);
+		sibling = parent->rbRight;
+	    }
+	    if ((sibling->rbLeft == NULL || !sibling->rbLeft->rbRed) &&
+		    (sibling->rbRight == NULL || !sibling->rbRight->rbRed)) {
+		sibling->rbRed = TRUE;
+		item = parent;
+		parent = item->rbParent;
+		continue;
+	    }
+	    if (sibling->rbRight == NULL || !sibling->rbRight->rbRed) {
+		sibling->rbLeft->rbRed = FALSE;
+		sibling->rbRed = TRUE;
+		RotateRight(sibling);
+		sibling = parent->rbRight;
+	    }
+	    sibling->rbRed = parent->rbRed;
+	    parent->rbRed = FALSE;
+	    if (sibling->rbRight != NULL)
+		sibling->rbRight->rbRed = FALSE;
+	    RotateLeft(parent);
+	} else {
+	    T *sibling = parent->rbLeft;
+	    if (sibling->rbRed) {
+		sibling->rbRed = FALSE;
+		parent->rbRed = TRUE;
+		RotateRight(parent);
+		sibling = parent->rbLeft;
+	    }
+	    if ((sibling->rbLeft == NULL || !sibling->rbLeft->rbRed) &&
+		    (sibling->rbRight == NULL || !sibling->rbRight->rbRed)) {
+		sibling->rbRed = TRUE;
+		item = parent;
+		parent = item->rbParent;
+		continue;
+	    }
+	    if (sibling->rbLeft == NULL || !sibling->rbLeft->rbRed) {
+		sibling->rbRight->rbRed = FALSE;
+		sibling->rbRed = TRUE;
+		RotateLeft(sibling);
+		sibling = parent->rbLeft;
+	    }
+	    sibling->rbRed = parent->rbRed;
+	    parent->rbRed = FALSE;
+	    if (sibling->rbLeft != NULL)
+		sibling->rbLeft->rbRed = FALSE;
+	    RotateRight(parent);
+	}
+	item = root;
+    }
+    if (item != NULL)
+	item->rbRed = FALSE;
+}
+
+template <class T, bool (*Before)(T *, T *)>
+void
+RBTree<T, Before>::Mapcar(VoidFunctionPtr func)
+{
+    for (T *item = leftmost; item != NULL; item = Next(item))
+	(*func)((int)item);
+}
+
+#endif // RBTREE_H
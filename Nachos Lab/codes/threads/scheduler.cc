@@ -31,6 +31,15 @@
 static void
 RRHandler(int dummy)
 {
+    if (CFS) {
+        scheduler->CFSTick();
+        return;
+    }
+    if (MLFQ) {
+        scheduler->MLFQTick();
+        return;
+    }
+
     int duration = stats->totalTicks - scheduler->prevTick;
     printf("Timer interrupt's duration is %d\n", duration);
     if(duration >= TimerTicks)
@@ -54,6 +63,48 @@ RRHandler(int dummy)
     }
 }
 
+//----------------------------------------------------------------------
+// CFSWeight
+// 	The CFS weight of a thread of priority "priority": its share of
+//	the CPU is its weight over the sum of the ready threads'.
+//	Priorities are read as Unix nice values, -20 .. 19 (lower is
+//	more important), each step worth about 10% of CPU time; the
+//	table is Linux's prio_to_weight.
+//----------------------------------------------------------------------
+
+#define NICE_0_WEIGHT 1024
+
+static const int prioToWeight[40] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+    9548, 7620, 6100, 4904, 3906,
+    3121, 2501, 1991, 1586, 1277,
+    1024, 820, 655, 526, 423,
+    335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45,
+    36, 29, 23, 18, 15,
+};
+
+static int
+CFSWeight(int priority)
+{
+    return prioToWeight[min(max(priority, -20), 19) + 20];
+}
+
+//----------------------------------------------------------------------
+// VruntimeBefore
+// 	The order of the CFS ready tree: by vruntime, and among equal
+//	vruntimes, by the order the threads were put in.
+//----------------------------------------------------------------------
+
+bool
+VruntimeBefore(Thread *a, Thread *b)
+{
+    if (a->vruntime != b->vruntime)
+        return a->vruntime < b->vruntime;
+    return a->vruntimeSeq < b->vruntimeSeq;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads to empty.
@@ -61,7 +112,15 @@ RRHandler(int dummy)
 
 Scheduler::Scheduler()
 { 
-    readyList = new List; 
+    readyList = new IntrusiveList<Thread>; 
+    for (int level = 0; level < NumQueueLevels; level++)
+        levelQueue[level] = new IntrusiveList<Thread>;
+    levelMask = 0;
+    lastCharge = 0;
+    lastBoost = 0;
+    cfsTree = new RBTree<Thread, VruntimeBefore>;
+    minVruntime = 0;
+    nextVruntimeSeq = 0;
 } 
 
 //----------------------------------------------------------------------
@@ -72,6 +131,9 @@ Scheduler::Scheduler()
 Scheduler::~Scheduler()
 { 
     delete readyList; 
+    for (int level = 0; level < NumQueueLevels; level++)
+        delete levelQueue[level];
+    delete cfsTree;
 } 
 
 //----------------------------------------------------------------------
@@ -87,16 +149,33 @@ Scheduler::ReadyToRun (Thread *thread)
 {
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
 
+    bool isNew = (thread->getStatus() == JUST_CREATED);
     thread->setStatus(READY);
 
     // change for lab2
-    if (RoundRobbin)
+    if (CFS)
     {
-        readyList->Append((void *)thread);
+        if (thread == currentThread)	// yielding: bill it before it goes
+            Charge(thread);		// into the tree
+        else if (isNew)
+            thread->vruntime = minVruntime;
+        else if (thread->vruntime < minVruntime - CFSSleeperCredit)
+            thread->vruntime = minVruntime - CFSSleeperCredit;
+        thread->vruntimeSeq = nextVruntimeSeq++;
+        cfsTree->Insert(thread);
+    }
+    else if (MLFQ)
+    {
+        levelQueue[thread->queueLevel]->Append(thread);
+        levelMask |= 1 << thread->queueLevel;
+    }
+    else if (RoundRobbin)
+    {
+        readyList->Append(thread);
     }
     else
     {
-        readyList->SortedInsert((void *)thread, thread->getPriority());
+        readyList->SortedInsert(thread, thread->getPriority());
         if(thread->getPriority() < currentThread->getPriority())
         {
             currentThread->Yield();
@@ -108,6 +187,10 @@ Scheduler::ReadyToRun (Thread *thread)
 // Scheduler::FindNextToRun
 // 	Return the next thread to be scheduled onto the CPU.
 //	If there are no ready threads, return NULL.
+//
+//	Under MLFQ the lowest set bit of levelMask is the highest level
+//	with a ready thread, so the pick does not depend on how many
+//	levels or threads there are.
 // Side effect:
 //	Thread is removed from the ready list.
 //----------------------------------------------------------------------
@@ -115,7 +198,24 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    return (Thread *)readyList->Remove();
+    if (CFS)
+    {
+        Thread *thread = cfsTree->First();	// least vruntime
+        if (thread != NULL)
+            cfsTree->Remove(thread);
+        return thread;
+    }
+    if (MLFQ)
+    {
+        if (levelMask == 0)
+            return NULL;
+        int level = __builtin_ffs(levelMask) - 1;
+        Thread *thread = levelQueue[level]->Remove();
+        if (levelQueue[level]->IsEmpty())
+            levelMask &= ~(1 << level);
+        return thread;
+    }
+    return readyList->Remove();
 }
 
 //----------------------------------------------------------------------
@@ -147,6 +247,9 @@ Scheduler::Run (Thread *nextThread)
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
 
+    if (MLFQ || CFS)
+        Charge(oldThread);		    // bill it for its last stint
+
     currentThread = nextThread;		    // switch to the next thread
     currentThread->setStatus(RUNNING);      // nextThread is now running
     
@@ -179,6 +282,112 @@ Scheduler::Run (Thread *nextThread)
 #endif
 }
 
+//----------------------------------------------------------------------
+// Scheduler::Charge
+// 	Add the busy ticks since the last charge to "thread"'s time at
+//	its current level, and, weighted, to its vruntime.  Idle ticks
+//	are left out, so a thread that slept while the machine idled is
+//	not billed for it.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Charge(Thread *thread)
+{
+    int now = stats->totalTicks - stats->idleTicks;
+    int ticks = now - lastCharge;
+
+    lastCharge = now;
+    thread->levelTicks += ticks;
+    thread->vruntime += (double) ticks * NICE_0_WEIGHT
+				/ CFSWeight(thread->getPriority());
+
+    double least = thread->vruntime;
+    if (!cfsTree->IsEmpty() && cfsTree->First()->vruntime < least)
+        least = cfsTree->First()->vruntime;
+    if (least > minVruntime)
+        minVruntime = least;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Boost
+// 	Move every thread back to level 0 and forget the time it has
+//	used there, so that threads pushed down by CPU-bound phases
+//	(or starved behind interactive ones) get a fresh start.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Boost()
+{
+    for (int i = 0; i < MAX_THREAD_NUM; i++)
+        if (used_TID[i] && Thread_Pointer[i] != NULL) {
+            Thread_Pointer[i]->queueLevel = 0;
+            Thread_Pointer[i]->levelTicks = 0;
+        }
+
+    for (int level = 1; level < NumQueueLevels; level++)
+        while (!levelQueue[level]->IsEmpty())
+            levelQueue[0]->Append(levelQueue[level]->Remove());
+    levelMask = levelQueue[0]->IsEmpty() ? 0 : 1;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::MLFQTick
+// 	Called from the timer interrupt when -mlfq is on.  Charges the
+//	running thread, boosts everyone every BoostTicks, and preempts
+//	the running thread if it used up its level's quantum (demoting
+//	it one level) or if a thread on a higher level is ready.
+//----------------------------------------------------------------------
+
+void
+Scheduler::MLFQTick()
+{
+    if (stats->totalTicks - stats->idleTicks - lastBoost >= BoostTicks) {
+        DEBUG('t', "MLFQ boost at tick %d\n", stats->totalTicks);
+        Boost();
+        lastBoost = stats->totalTicks - stats->idleTicks;
+    }
+
+    if (interrupt->getStatus() == IdleMode)	// nobody is running
+        return;
+
+    Charge(currentThread);
+    int level = currentThread->queueLevel;
+    if (currentThread->levelTicks >= LevelQuantum(level)) {
+        if (level < NumQueueLevels - 1)
+            currentThread->queueLevel++;
+        currentThread->levelTicks = 0;
+        DEBUG('t', "Thread \"%s\" used its quantum, now at level %d\n",
+              currentThread->getName(), currentThread->queueLevel);
+        interrupt->YieldOnReturn();
+    } else if (levelMask & ((1 << level) - 1)) {	// higher level ready
+        interrupt->YieldOnReturn();
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::CFSTick
+// 	Called from the timer interrupt when -cfs is on.  Charges the
+//	running thread, and preempts it if its vruntime is more than
+//	CFSGranularity past the least vruntime of the ready threads.
+//----------------------------------------------------------------------
+
+void
+Scheduler::CFSTick()
+{
+    if (interrupt->getStatus() == IdleMode)	// nobody is running
+        return;
+
+    Charge(currentThread);
+    Thread *next = cfsTree->First();
+    if (next != NULL
+            && currentThread->vruntime - next->vruntime > CFSGranularity) {
+        DEBUG('t', "Thread \"%s\" is %d ticks ahead, preempting\n",
+              currentThread->getName(),
+              (int) (currentThread->vruntime - next->vruntime));
+        interrupt->YieldOnReturn();
+    }
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Print
 // 	Print the scheduler state -- in other words, the contents of
@@ -187,6 +396,19 @@ Scheduler::Run (Thread *nextThread)
 void
 Scheduler::Print()
 {
+    if (CFS) {
+        printf("Ready tree contents:\n");
+        cfsTree->Mapcar((VoidFunctionPtr) ThreadPrint);
+        return;
+    }
+    if (MLFQ) {
+        for (int level = 0; level < NumQueueLevels; level++)
+            if (!levelQueue[level]->IsEmpty()) {
+                printf("Level %d:\n", level);
+                levelQueue[level]->Mapcar((VoidFunctionPtr) ThreadPrint);
+            }
+        return;
+    }
     printf("Ready list contents:\n");
     readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
 }
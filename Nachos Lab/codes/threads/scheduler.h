@@ -11,8 +11,30 @@
 
 #include "copyright.h"
 #include "list.h"
+#include "rbtree.h"
 #include "thread.h"
 
+// Multi-level feedback queue (-mlfq): a thread that uses up the
+// quantum of its level is demoted one level; every BoostTicks all
+// threads go back to level 0, so nothing starves.
+
+#define NumQueueLevels	8			// 0 is the highest
+#define LevelQuantum(level) (TimerTicks << (level))	// busy ticks a 
+							// thread may run 
+							// at "level"
+#define BoostTicks	(50 * TimerTicks)
+
+// Completely fair scheduling (-cfs): the ready thread with the least
+// virtual runtime runs next, and the running thread is preempted once
+// it gets more than CFSGranularity ahead of it.  A thread waking up is
+// given at most CFSSleeperCredit of vruntime below the minimum, so a
+// long sleep does not buy it a long monopoly of the CPU.
+
+#define CFSGranularity	TimerTicks
+#define CFSSleeperCredit (3 * TimerTicks)
+
+extern bool VruntimeBefore(Thread *a, Thread *b);	// CFS tree order
+
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
@@ -27,10 +49,29 @@ class Scheduler {
 					// list, if any, and return thread.
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
+    void MLFQTick();			// Timer tick under MLFQ: demote,
+					// boost, or preempt
+    void CFSTick();			// Timer tick under CFS: preempt if
+					// the running thread is too far ahead
     
   private:
-    List *readyList;  		// queue of threads that are ready to run,
-				// but not running
+    IntrusiveList<Thread> *readyList;	// queue of threads that are ready 
+					// to run, but not running
+    IntrusiveList<Thread> *levelQueue[NumQueueLevels];	// MLFQ: the ready threads of
+    unsigned int levelMask;	// each level; bit i set iff level i's
+				// queue is not empty
+    int lastCharge;		// MLFQ: busy time when the running thread
+				// was last charged for its ticks
+    int lastBoost;		// MLFQ: busy time of the last boost
+    RBTree<Thread, VruntimeBefore> *cfsTree;	// CFS: the ready threads
+    double minVruntime;		// CFS: never decreasing floor of the
+				// ready and running threads' vruntime
+    int nextVruntimeSeq;	// CFS: next tie-break number
+
+    void Charge(Thread *thread);	// add the busy ticks since
+					// lastCharge to thread's
+					// levelTicks and vruntime
+    void Boost();			// put every thread back on level 0
   public:
     int prevTick;		// used for lab2 challenge--RR algorithm
 
@@ -37,7 +37,7 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List;
+    queue = new IntrusiveList<Thread>;
 }
 
 //----------------------------------------------------------------------
@@ -67,7 +67,7 @@ Semaphore::P()
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
     //printf("%s %d\n",name,  value);
     while (value == 0) { 			// semaphore not available
-	queue->Append((void *)currentThread);	// so go to sleep
+	queue->Append(currentThread);	// so go to sleep
 	currentThread->Sleep();
     } 
     value--; 					// semaphore available, 
@@ -90,7 +90,7 @@ Semaphore::V()
     Thread *thread;
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
-    thread = (Thread *)queue->Remove();
+    thread = queue->Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
     value++;
@@ -203,7 +203,7 @@ bool Lock::isHeldByCurrentThread()
 Condition::Condition(char* debugName) 
 {
     name = debugName;
-    waitQueue = new List();
+    waitQueue = new IntrusiveList<Thread>;
 }
 
 //----------------------------------------------------------------------
@@ -261,7 +261,7 @@ void Condition::Signal(Lock* conditionLock)
     // Step 1: Wake up the first thread in waitQueue.
      if(!waitQueue->IsEmpty())
      {
-         Thread* t = (Thread*) waitQueue->Remove();
+         Thread* t = waitQueue->Remove();
          scheduler->ReadyToRun(t);
      }
 
@@ -285,7 +285,7 @@ void Condition::Broadcast(Lock* conditionLock)
     // Step 1: Wake up all threads in waitQueue.
     while(!waitQueue->IsEmpty())
     {
-        Thread* t = (Thread*) waitQueue->Remove();
+        Thread* t = waitQueue->Remove();
         scheduler->ReadyToRun(t);
     }
 
@@ -48,7 +48,8 @@ class Semaphore {
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List *queue;       // threads waiting in P() for the value to be > 0
+    IntrusiveList<Thread> *queue;	// threads waiting in P() for the 
+				// value to be > 0
 };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -138,7 +139,7 @@ class Condition {
     // plus some other stuff you'll need to define
 
     /* ---------------------------    added by Li cong 1800012826 --------------------------- */    
-    List* waitQueue;
+    IntrusiveList<Thread>* waitQueue;
 };
 
 //----------------------------------------------------------------------
@@ -29,6 +29,16 @@ SynchDisk   *synchDisk;
 
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
 Machine *machine;	// user program memory and registers
+bool BlockEngine;	// use the basic-block engine (-bb)
+bool BenchMode;		// Halt only ends the program (-bench)
+int ReadAheadMax;	// read-ahead window cap (-ra)
+int PhysPages;		// physical memory size in frames (-mem)
+int TLBEntries;		// TLB entries (-tlbsize)
+int TLBWays;		// and per set (-tlbways)
+TLBReplacementPolicy TLBReplacement;	// (-tlbpolicy)
+#ifdef USE_DISK
+SwapSpace *swapSpace;	// swap area at the end of the disk
+#endif
 #endif
 
 #ifdef NETWORK
@@ -79,6 +89,8 @@ bool used_TID[MAX_THREAD_NUM];
 int end_state[MAX_THREAD_NUM];
 Thread *Thread_Pointer[MAX_THREAD_NUM];
 bool RoundRobbin;
+bool MLFQ;
+bool CFS;
 Lock* tableLock;
 Lock* threadLock;
 
@@ -89,6 +101,8 @@ Initialize(int argc, char **argv)
     char* debugArgs = "";
     bool randomYield = FALSE;
     RoundRobbin = FALSE;
+    MLFQ = FALSE;
+    CFS = FALSE;
 
 /*******************************   added by Li Cong 1800012826   *******************************/
 
@@ -105,6 +119,17 @@ Initialize(int argc, char **argv)
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
+    BlockEngine = FALSE;
+    BenchMode = FALSE;
+    ReadAheadMax = 4;
+    PhysPages = DefaultPhysPages;
+    TLBEntries = TLBSize;
+    TLBWays = 0;		// fully associative, unless given
+#ifdef USE_CLOCK
+    TLBReplacement = TLBReplaceClock;
+#else
+    TLBReplacement = TLBReplaceFIFO;
+#endif
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
@@ -133,10 +158,52 @@ Initialize(int argc, char **argv)
 
         if (!strcmp(*argv, "-rr"))		// added for Round Robbin algorithm
             RoundRobbin = TRUE;
+        if (!strcmp(*argv, "-mlfq"))		// multi-level feedback queue
+            MLFQ = TRUE;
+        if (!strcmp(*argv, "-cfs"))		// completely fair scheduler
+            CFS = TRUE;
 
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
 	    debugUserProg = TRUE;
+	if (!strcmp(*argv, "-bb"))		// basic-block engine
+	    BlockEngine = TRUE;
+	if (!strcmp(*argv, "-ra")) {		// read-ahead window
+	    ASSERT(argc > 1);
+	    ReadAheadMax = max(atoi(*(argv + 1)), 0);
+	    argCount = 2;
+	}
+	if (!strcmp(*argv, "-mem")) {		// physical memory, in frames
+	    ASSERT(argc > 1);
+	    PhysPages = atoi(*(argv + 1));
+	    argCount = 2;
+	}
+	if (!strcmp(*argv, "-tlbsize")) {	// TLB entries
+	    ASSERT(argc > 1);
+	    TLBEntries = atoi(*(argv + 1));
+	    argCount = 2;
+	}
+	if (!strcmp(*argv, "-tlbways")) {	// TLB associativity
+	    ASSERT(argc > 1);
+	    TLBWays = atoi(*(argv + 1));
+	    argCount = 2;
+	}
+	if (!strcmp(*argv, "-tlbpolicy")) {	// TLB replacement
+	    ASSERT(argc > 1);
+	    if (!strcmp(*(argv + 1), "fifo"))
+		TLBReplacement = TLBReplaceFIFO;
+	    else if (!strcmp(*(argv + 1), "clock"))
+		TLBReplacement = TLBReplaceClock;
+	    else if (!strcmp(*(argv + 1), "lru"))
+		TLBReplacement = TLBReplaceLRU;
+	    else if (!strcmp(*(argv + 1), "random"))
+		TLBReplacement = TLBReplaceRandom;
+	    else {
+		printf("Unknown TLB replacement policy %s\n", *(argv + 1));
+		ASSERT(FALSE);
+	    }
+	    argCount = 2;
+	}
 #endif
 #ifdef FILESYS_NEEDED
 	if (!strcmp(*argv, "-f"))
@@ -162,7 +229,7 @@ Initialize(int argc, char **argv)
     if (randomYield)				// start the timer (if needed)
 	timer = new Timer(TimerInterruptHandler, 0, randomYield);
 
-    if (RoundRobbin)				// timer device for Round Robbin
+    if (RoundRobbin || MLFQ || CFS)		// timer device for Round Robbin
         timer = new Timer(RRHandler, 0, false);
 
     threadToBeDestroyed = NULL;
@@ -178,6 +245,8 @@ Initialize(int argc, char **argv)
     
 #ifdef USER_PROGRAM
     machine = new Machine(debugUserProg);	// this must come first
+    ReadAheadMax = min(ReadAheadMax, 
+	min(MaxReadAhead, machine->numPhysPages - 1));
 #endif
 
 #ifdef FILESYS
@@ -188,6 +257,10 @@ Initialize(int argc, char **argv)
     fileSystem = new FileSystem(format);
 #endif
 
+#ifdef USE_DISK
+    swapSpace = new SwapSpace();
+#endif
+
 #ifdef NETWORK
     postOffice = new PostOffice(netname, rely, 10);
 #endif
@@ -210,6 +283,10 @@ Cleanup()
     delete machine;
 #endif
 
+#ifdef USE_DISK
+    delete swapSpace;
+#endif
+
 #ifdef FILESYS_NEEDED
     delete fileSystem;
 #endif
@@ -25,6 +25,8 @@ extern bool used_TID[MAX_THREAD_NUM];
 extern int end_state[MAX_THREAD_NUM];
 extern Thread *Thread_Pointer[MAX_THREAD_NUM];
 extern bool RoundRobbin;
+extern bool MLFQ;		// multi-level feedback queue scheduling
+extern bool CFS;		// completely fair scheduling
 extern bool VERBOSE; 
 extern Lock* tableLock;
 extern Lock* threadLock;
@@ -45,6 +47,18 @@ extern Timer *timer;				// the hardware alarm clock
 #ifdef USER_PROGRAM
 #include "machine.h"
 extern Machine* machine;	// user program memory and registers
+extern bool BlockEngine;	// run user code a basic block at a time
+extern bool BenchMode;		// the -bench driver is running programs
+extern int ReadAheadMax;	// most pages read ahead on a page fault
+extern int PhysPages;		// frames of memory the machine is built with
+enum TLBReplacementPolicy { TLBReplaceFIFO, TLBReplaceClock, 
+			    TLBReplaceLRU, TLBReplaceRandom };
+extern int TLBEntries;		// TLB geometry the machine is built with
+extern int TLBWays;
+extern TLBReplacementPolicy TLBReplacement;	// how TLB misses replace
+#ifdef USE_DISK
+extern SwapSpace *swapSpace;	// where pages evicted dirty are kept
+#endif
 #endif
 
 #ifdef FILESYS_NEEDED 		// FILESYS or FILESYS_STUB 
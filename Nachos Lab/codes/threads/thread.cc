@@ -24,6 +24,53 @@
 					// execution stack, for detecting 
 					// stack overflows
 
+// Creating and destroying threads is frequent (every Fork and Exec
+// system call), so rather than going back to the heap, and to
+// AllocBoundedArray's guard pages, every time, finished Thread objects
+// and their stacks are kept for the next thread.  There can never be
+// more than MAX_THREAD_NUM of either alive, so that bounds the pools.
+
+static void *freeThreads[MAX_THREAD_NUM];	// storage of deleted Threads
+static int numFreeThreads = 0;
+static int *freeStacks[MAX_THREAD_NUM];		// stacks of deleted Threads,
+static int numFreeStacks = 0;			// guard pages still in place
+
+//----------------------------------------------------------------------
+// Thread::operator new
+// 	Get the storage for a Thread, from the pool if it has any.
+//----------------------------------------------------------------------
+
+void *
+Thread::operator new(size_t size)
+{
+    void *ptr;
+
+    ASSERT(size == sizeof(Thread));
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    if (numFreeThreads > 0)
+        ptr = freeThreads[--numFreeThreads];
+    else
+        ptr = ::operator new(size);
+    (void) interrupt->SetLevel(oldLevel);
+    return ptr;
+}
+
+//----------------------------------------------------------------------
+// Thread::operator delete
+// 	Put the storage of a deleted Thread back in the pool.
+//----------------------------------------------------------------------
+
+void
+Thread::operator delete(void *ptr)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    if (numFreeThreads < MAX_THREAD_NUM)
+        freeThreads[numFreeThreads++] = ptr;
+    else
+        ::operator delete(ptr);
+    (void) interrupt->SetLevel(oldLevel);
+}
+
 //----------------------------------------------------------------------
 // Thread::Thread
 // 	Initialize a thread control block, so that we can then call
@@ -45,6 +92,14 @@ Thread::Thread(char* threadName)
 /*******************************   added by Li Cong 1800012826   *******************************/
     
     this->priority = 0; // for lab2
+    this->queueLevel = 0;
+    this->levelTicks = 0;
+    this->listNext = NULL;
+    this->listKey = 0;
+    this->vruntime = 0;
+    this->vruntimeSeq = 0;
+    this->rbLeft = this->rbRight = this->rbParent = NULL;
+    this->rbRed = FALSE;
 
     this->TID = -1;
     IntStatus old =  interrupt->SetLevel(IntOff);
@@ -93,6 +148,14 @@ Thread::Thread(char* threadName, int p)
 #endif
     
     this->priority = p; // for lab2
+    this->queueLevel = min(max(p, 0), NumQueueLevels - 1);
+    this->levelTicks = 0;
+    this->listNext = NULL;
+    this->listKey = 0;
+    this->vruntime = 0;
+    this->vruntimeSeq = 0;
+    this->rbLeft = this->rbRight = this->rbParent = NULL;
+    this->rbRed = FALSE;
 
     this->TID = -1;
     IntStatus old =  interrupt->SetLevel(IntOff);
@@ -133,8 +196,14 @@ Thread::~Thread()
     DEBUG('t', "Deleting thread \"%s\"\n", name);
 
     ASSERT(this != currentThread);
-    if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    if (stack != NULL) {
+	IntStatus oldLevel = interrupt->SetLevel(IntOff);
+	if (numFreeStacks < MAX_THREAD_NUM)	// keep it for the next thread
+	    freeStacks[numFreeStacks++] = stack;
+	else
+	    DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+	(void) interrupt->SetLevel(oldLevel);
+    }
 
 /*******************************   added by Li Cong 1800012826   *******************************/
 
@@ -207,11 +276,17 @@ Thread::getPriority(){return priority;}
 
 //----------------------------------------------------------------------
 // Thread::setPriority
-//	Set thread's scheduling priority.
+//	Set thread's scheduling priority; under MLFQ this also moves it
+//	to the matching queue level, from the next time it is queued.
 //----------------------------------------------------------------------
 
 void
-Thread::setPriority(int p){priority = p;}
+Thread::setPriority(int p)
+{
+    priority = p;
+    queueLevel = min(max(p, 0), NumQueueLevels - 1);
+    levelTicks = 0;
+}
 
 /*******************************   added by Li Cong 1800012826   *******************************/
 
@@ -419,6 +494,9 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 //		calls (*func)(arg)
 //		calls Thread::Finish
 //
+//	A stack left behind by a deleted thread is reused if there is
+//	one; only its initial frame and fencepost need to be rewritten.
+//
 //	"func" is the procedure to be forked
 //	"arg" is the parameter to be passed to the procedure
 //----------------------------------------------------------------------
@@ -426,7 +504,12 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 void
 Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    if (numFreeStacks > 0)
+	stack = freeStacks[--numFreeStacks];
+    else
+	stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    (void) interrupt->SetLevel(oldLevel);
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
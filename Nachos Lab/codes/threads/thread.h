@@ -99,6 +99,21 @@ class Thread {
 
     Thread(char* debugName, int p);
 
+    int queueLevel;	// MLFQ: the ready queue this thread goes on,
+			// 0 (highest) .. NumQueueLevels-1
+    int levelTicks;	// MLFQ: busy ticks run at that level so far
+
+    Thread *listNext;	// next thread on the ready or wait queue this
+    int listKey;	// thread is on (see IntrusiveList), and its key
+
+    double vruntime;	// CFS: busy ticks run, scaled by the thread's
+			// weight, so a heavier thread's grow slower
+    int vruntimeSeq;	// CFS: breaks vruntime ties first-come first-served
+    Thread *rbLeft;	// CFS: links and color in the ready tree
+    Thread *rbRight;	// (see RBTree)
+    Thread *rbParent;
+    bool rbRed;
+
     /*******************************   added by Li Cong 1800012826   *******************************/
 
   public:
@@ -107,6 +122,9 @@ class Thread {
 					// NOTE -- thread being deleted
 					// must not be running when delete 
 					// is called
+    void *operator new(size_t size);	// Thread objects and stacks are
+    void operator delete(void *ptr);	// recycled, not freed; see 
+					// thread.cc
 
     // basic thread operations
 
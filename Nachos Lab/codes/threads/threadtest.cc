@@ -54,6 +54,202 @@ ThreadTest1()
     SimpleThread(0);
 }
 
+//----------------------------------------------------------------------
+// InterruptQueueTest
+// 	Microbenchmark for the pending interrupt queue.  Schedule
+//	NumQueueEvents interrupts at random times, then advance the
+//	simulated clock until all of them have fired, checking that
+//	they fire in time order, and first-come first-served among
+//	interrupts due at the same time.  Reports the host CPU time
+//	per Schedule and per interrupt fired.
+//----------------------------------------------------------------------
+
+#define NumQueueEvents 100000
+
+static int *eventWhen;		// when each event was scheduled to fire
+static int eventsFired;
+static int lastFired;
+static bool eventOrderOk;
+
+static void
+QueueEventHandler(int which)
+{
+    if (eventsFired > 0 && (eventWhen[which] < eventWhen[lastFired] ||
+	    (eventWhen[which] == eventWhen[lastFired] && which < lastFired)))
+        eventOrderOk = FALSE;
+    lastFired = which;
+    eventsFired++;
+}
+
+void
+InterruptQueueTest()
+{
+    DEBUG('t', "Entering InterruptQueueTest");
+
+    eventWhen = new int[NumQueueEvents];
+    eventsFired = 0;
+    eventOrderOk = TRUE;
+
+    double start = HostCPUTime();
+    for (int i = 0; i < NumQueueEvents; i++)
+    {
+        int fromNow = 1 + Random() % 10000;
+        eventWhen[i] = stats->totalTicks + fromNow;
+        interrupt->Schedule(QueueEventHandler, i, fromNow, TimerInt);
+    }
+    double scheduled = HostCPUTime();
+    while (eventsFired < NumQueueEvents)
+        interrupt->OneTick();
+    double fired = HostCPUTime();
+
+    printf("Scheduled %d interrupts in %.3f s (%.1f ns each), "
+        "fired them in %.3f s (%.1f ns each), order %s\n",
+        NumQueueEvents, scheduled - start,
+        (scheduled - start) * 1e9 / NumQueueEvents, fired - scheduled,
+        (fired - scheduled) * 1e9 / NumQueueEvents,
+        eventOrderOk ? "ok" : "WRONG");
+    delete [] eventWhen;
+}
+
+//----------------------------------------------------------------------
+// ContextSwitchTest
+// 	Microbenchmark for blocking and context switching.  Two threads
+//	hand a token back and forth NumSwitchRounds times through a pair
+//	of semaphores, so every round blocks on a wait queue, wakes the
+//	other thread onto the ready queue and switches twice.  Then the
+//	same two threads just Yield to each other.  Reports the host CPU
+//	time per context switch for each.
+//----------------------------------------------------------------------
+
+#define NumSwitchRounds 100000
+
+static Semaphore *pingSem;
+static Semaphore *pongSem;
+static Semaphore *switchDone;
+
+static void
+PongThread(int dummy)
+{
+    for (int i = 0; i < NumSwitchRounds; i++)
+    {
+        pingSem->P();
+        pongSem->V();
+    }
+    for (int i = 0; i < NumSwitchRounds; i++)
+        currentThread->Yield();
+    switchDone->V();
+}
+
+void
+ContextSwitchTest()
+{
+    DEBUG('t', "Entering ContextSwitchTest");
+
+    pingSem = new Semaphore("ping", 0);
+    pongSem = new Semaphore("pong", 0);
+    switchDone = new Semaphore("switch test done", 0);
+
+    Thread *t = new Thread("pong");
+    t->Fork(PongThread, (void *)0);
+
+    double start = HostCPUTime();
+    for (int i = 0; i < NumSwitchRounds; i++)
+    {
+        pingSem->V();
+        pongSem->P();
+    }
+    double blocked = HostCPUTime();
+    for (int i = 0; i < NumSwitchRounds; i++)
+        currentThread->Yield();
+    double yielded = HostCPUTime();
+    switchDone->P();
+
+    printf("Semaphore ping-pong: %d switches in %.3f s (%.1f ns each)\n",
+        2 * NumSwitchRounds, blocked - start,
+        (blocked - start) * 1e9 / (2 * NumSwitchRounds));
+    printf("Yield ping-pong: %d switches in %.3f s (%.1f ns each)\n",
+        2 * NumSwitchRounds, yielded - blocked,
+        (yielded - blocked) * 1e9 / (2 * NumSwitchRounds));
+    delete pingSem;
+    delete pongSem;
+    delete switchDone;
+}
+
+//----------------------------------------------------------------------
+// RBTreeTest
+// 	Check the red-black tree the CFS scheduler keeps its ready
+//	threads in.  NumTreeThreads threads, with random vruntimes drawn
+//	from a narrow range so that many tie, are put into and taken out
+//	of a tree at random for NumTreeRounds rounds; after every step
+//	First() must be the least of them in VruntimeBefore order, and
+//	NumInTree() must count them.  Then the tree is emptied from the
+//	front, and the threads must come out in order.
+//----------------------------------------------------------------------
+
+#define NumTreeThreads 64
+#define NumTreeRounds 100000
+
+void
+RBTreeTest()
+{
+    DEBUG('t', "Entering RBTreeTest");
+
+    RBTree<Thread, VruntimeBefore> *tree = new RBTree<Thread, VruntimeBefore>;
+    Thread *threads[NumTreeThreads];
+    bool inTree[NumTreeThreads];
+    unsigned int count = 0;
+    int seq = 0;
+    bool orderOk = TRUE;
+    int i, j;
+
+    for (i = 0; i < NumTreeThreads; i++)
+    {
+        threads[i] = new Thread("tree test");
+        inTree[i] = FALSE;
+    }
+    for (i = 0; i < NumTreeRounds; i++)
+    {
+        int which = Random() % NumTreeThreads;
+        if (inTree[which])
+        {
+            tree->Remove(threads[which]);
+            count--;
+        }
+        else
+        {
+            Thread *t = threads[which];
+            t->vruntime = Random() % (NumTreeThreads / 4);
+            t->vruntimeSeq = seq++;
+            tree->Insert(t);
+            count++;
+        }
+        inTree[which] = !inTree[which];
+
+        Thread *first = tree->First();
+        if (tree->NumInTree() != count || (count == 0) != (first == NULL))
+            orderOk = FALSE;
+        for (j = 0; j < NumTreeThreads; j++)
+            if (inTree[j] && VruntimeBefore(threads[j], first))
+                orderOk = FALSE;
+    }
+    for (Thread *last = NULL; !tree->IsEmpty(); count--)
+    {
+        Thread *first = tree->First();
+        if (last != NULL && !VruntimeBefore(last, first))
+            orderOk = FALSE;
+        tree->Remove(first);
+        last = first;
+    }
+    if (count != 0 || tree->NumInTree() != 0)
+        orderOk = FALSE;
+
+    printf("Red-black tree: %d inserts and removes on %d threads, order %s\n",
+        NumTreeRounds, NumTreeThreads, orderOk ? "ok" : "WRONG");
+    for (i = 0; i < NumTreeThreads; i++)
+        delete threads[i];
+    delete tree;
+}
+
 
 
 
@@ -990,6 +1186,15 @@ ThreadTest()
         Lab3Challenge2_1();
         break;
 /*******************************   added by Li Cong 1800012826   *******************************/
+    case 16:
+        InterruptQueueTest();
+        break;
+    case 17:
+        ContextSwitchTest();
+        break;
+    case 18:
+        RBTreeTest();
+        break;
     default:
 	printf("No test specified.\n");
 	break;
@@ -65,6 +65,27 @@ extern bool DebugIsEnabled(char flag); 	// Is this debug flag enabled?
 extern void DEBUG (char flag, char* format, ...);  	// Print debug message 
 							// if flag is enabled
 
+// Debug messages on the simulator's hot paths (one per instruction,
+// memory reference or tick) use DEBUG_HOT and HotDebugIsEnabled
+// instead.  Whether a flag is compiled in at all is decided by
+// DebugCompiled<flag>, a compile-time constant, so the check is folded
+// away: normally every flag is compiled in and we only pay for the
+// DebugIsEnabled test, but "make fast" (-DHOT_DEBUG_OFF) turns off
+// 'a', 'm' and 'i', and those call sites then generate no code at all.
+
+template <char flag> struct DebugCompiled { enum { value = TRUE }; };
+#ifdef HOT_DEBUG_OFF
+template <> struct DebugCompiled<'a'> { enum { value = FALSE }; };
+template <> struct DebugCompiled<'m'> { enum { value = FALSE }; };
+template <> struct DebugCompiled<'i'> { enum { value = FALSE }; };
+#endif
+
+#define HotDebugIsEnabled(flag) \
+    (DebugCompiled<flag>::value && DebugIsEnabled(flag))
+
+#define DEBUG_HOT(flag, ...) \
+    do { if (HotDebugIsEnabled(flag)) DEBUG(flag, __VA_ARGS__); } while (0)
+
 //----------------------------------------------------------------------
 // ASSERT
 //      If condition is false,  print a message and dump core.
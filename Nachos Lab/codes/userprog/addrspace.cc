@@ -18,7 +18,6 @@
 #include "copyright.h"
 #include "system.h"
 #include "addrspace.h"
-#include "noff.h"
 #ifdef HOST_SPARC
 #include <strings.h>
 #endif
@@ -45,6 +44,40 @@ SwapHeader (NoffHeader *noffH)
 	noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
 }
 
+#if (defined(USE_BITMAP) && !defined(USE_DISK)) || defined(INVERTED_PAGETABLE)
+//----------------------------------------------------------------------
+// CopySegment
+// 	Load "segment" of the executable into the frames its pages were
+//	given, "frames[vpn]".  The whole segment is read in one ReadAt, 
+//	so each sector of it is read once, and then copied a page at a
+//	time, since the frames need not be contiguous.
+//----------------------------------------------------------------------
+
+static void
+CopySegment(OpenFile *executable, Segment *segment, int *frames)
+{
+    int end = segment->virtualAddr + segment->size;
+    char *buf;
+
+    if (segment->size <= 0)
+        return;
+    DEBUG('a', "Initializing segment, at 0x%x, size %d\n", 
+			segment->virtualAddr, segment->size);
+    buf = new char[segment->size];
+    executable->ReadAt(buf, segment->size, segment->inFileAddr);
+    for (int addr = segment->virtualAddr; addr < end; )
+    {
+        int offset = addr % PageSize;
+        int count = min(PageSize - offset, end - addr);
+        bcopy(&buf[addr - segment->virtualAddr], 
+            &(machine->mainMemory[frames[addr / PageSize]*PageSize + offset]),
+            count);
+        addr += count;
+    }
+    delete [] buf;
+}
+#endif
+
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
 // 	Create an address space to run a user program.
@@ -64,7 +97,6 @@ int SpaceCnt = 0;
 
 AddrSpace::AddrSpace(OpenFile *executable)
 {
-    NoffHeader noffH;
     unsigned int i, size;
 
     executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
@@ -73,6 +105,18 @@ AddrSpace::AddrSpace(OpenFile *executable)
     ASSERT(noffH.noffMagic == NOFFMAGIC);
 
     exeSector = executable->GetHeaderSector();
+    spaceId = SpaceCnt++;
+    asid = -1;
+    exeFile = NULL;
+    swapSlot = NULL;
+    nextFault = -1;
+    readAhead = 0;
+    runTicks = runStart = 0;
+    resident = 0;
+    quota = WorkingSetMin;
+    suspended = FALSE;
+    faults = 0;
+    lastSample = 0;
 
 // how big is address space?
     size = noffH.code.size + noffH.initData.size + noffH.uninitData.size 
@@ -80,20 +124,16 @@ AddrSpace::AddrSpace(OpenFile *executable)
 						// to leave room for the stack
     numPages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
+    zeroFillFrom = divRoundUp(max(noffH.code.virtualAddr + noffH.code.size,
+        noffH.initData.virtualAddr + noffH.initData.size), PageSize);
 
 #ifndef INVERTED_PAGETABLE
 
 #ifndef USE_DISK
-    ASSERT(numPages <= NumPhysPages);		// check we're not trying
+    ASSERT(numPages <= (unsigned) machine->numPhysPages);	// check we're not trying
 						// to run anything too big --
 						// at least until we have
 						// virtual memory
-#else // USE_DISK
-    char str[20];
-    sprintf(str, "VirtualMemory%d", SpaceCnt++);
-    VMName = strdup(str);
-    bool succeed_creating_file = fileSystem->Create(VMName, MemorySize);
-    ASSERT(succeed_creating_file);
 #endif
 
     DEBUG('a', "Initializing address space, num pages %d, size %d\n", 
@@ -107,6 +147,10 @@ AddrSpace::AddrSpace(OpenFile *executable)
 #if USE_BITMAP
         pageTable[i].physicalPage = machine->allocateMem();
         ASSERT(pageTable[i].physicalPage!=-1);
+        machine->coreMap[pageTable[i].physicalPage].space = this;
+        machine->coreMap[pageTable[i].physicalPage].vpn = i;
+        machine->coreMap[pageTable[i].physicalPage].refs = 1;
+        machine->coreMap[pageTable[i].physicalPage].prefetched = FALSE;
 #else // USE_BITMAP
 	    pageTable[i].physicalPage = i;
 #endif // USE_BITMAP
@@ -126,44 +170,26 @@ AddrSpace::AddrSpace(OpenFile *executable)
 
 #if USE_BITMAP
     // clear main memory used by current program
+    int *frames = new int[numPages];
     for(int i=0; i<numPages; ++i)
     {
-        for(int j=0; j<PageSize; ++j)
-        {
-            machine->mainMemory[pageTable[i].physicalPage*PageSize+j] = 0;
-        }
-    }
-    
-    // allocate data and code sections, we need to translate sections' virtualAddr to physicalAddr
-    // one byte per loop
-    for(int VA=noffH.code.virtualAddr, cnt=0; VA<noffH.code.size; ++VA, ++cnt)
-    {
-        unsigned int VPN = VA / PageSize;
-        unsigned int PPN = pageTable[VPN].physicalPage;
-        unsigned int PPO = VA % PageSize;
-        unsigned int PA = PPN*PageSize + PPO;
-        //printf("%d 0x%x %d 0x%x\n", PA, PA, VA, VA);
-        executable->ReadAt(&(machine->mainMemory[PA]),
-			1, noffH.code.inFileAddr+cnt);
-	//printf("%d 0x%x\n", machine->mainMemory[PA], machine->mainMemory[PA]);
+        frames[i] = pageTable[i].physicalPage;
+        bzero(&(machine->mainMemory[frames[i]*PageSize]), PageSize);
+        machine->InvalidateFrame(frames[i]);
     }
     
-    for(int VA=noffH.initData.virtualAddr, cnt=0; VA<noffH.initData.size; ++VA, ++cnt)
-    {
-        unsigned int VPN = VA / PageSize;
-        unsigned int PPN = pageTable[VPN].physicalPage;
-        unsigned int PPO = VA % PageSize;
-        unsigned int PA = PPN*PageSize + PPO;
-        //printf("%d 0x%x %d 0x%x\n", PA, PA, VA, VA);
-        executable->ReadAt(&(machine->mainMemory[PA]),
-			1, noffH.initData.inFileAddr+cnt);
-	//printf("%d 0x%x\n", machine->mainMemory[PA], machine->mainMemory[PA]);
-    }
+    // then copy in the code and data sections, each into the frames
+    // of its pages
+    CopySegment(executable, &noffH.code, frames);
+    CopySegment(executable, &noffH.initData, frames);
+    delete [] frames;
 
 #else // USE_BITMAP
 // zero out the entire address space, to zero the unitialized data segment 
 // and the stack segment
     bzero(machine->mainMemory, size);
+    for (i = 0; i < numPages; i++)
+        machine->InvalidateFrame(i);
 
 // then, copy in the code and data segments into memory
     if (noffH.code.size > 0) {
@@ -181,102 +207,149 @@ AddrSpace::AddrSpace(OpenFile *executable)
 #endif // USE_BITMAP
 
 #else // USE_DISK
-    DEBUG('P', "Demand paging: copy executable to virtual memory %s!\n", VMName);
-    OpenFile *vm = fileSystem->Open(VMName);
-    char *VM_tmp = new char[size];
-    bzero(VM_tmp, size);
-    if (noffH.code.size > 0) {
-        DEBUG('a', "Initializing code segment, at 0x%x, size %d\n", 
-			noffH.code.virtualAddr, noffH.code.size);
-        executable->ReadAt(&(VM_tmp[noffH.code.virtualAddr]),
-			noffH.code.size, noffH.code.inFileAddr);
-    }
-    if (noffH.initData.size > 0) {
-        DEBUG('a', "Initializing data segment, at 0x%x, size %d\n", 
-			noffH.initData.virtualAddr, noffH.initData.size);
-        executable->ReadAt(&(VM_tmp[noffH.initData.virtualAddr]),
-			noffH.initData.size, noffH.initData.inFileAddr);
-    }
-    vm->WriteAt(VM_tmp, size, 0);
-    delete vm;
+// nothing is loaded now: each page is faulted in from the executable
+// the first time it is touched (see PageIn), and goes to the swap 
+// area only if it is evicted dirty
+    DEBUG('P', "Demand paging: %d pages of space %d come from the executable!\n", 
+            numPages, spaceId);
+    exeFile = new OpenFile(exeSector);
+    swapSlot = new int[numPages];
+    for (i = 0; i < numPages; i++)
+        swapSlot[i] = -1;
 #endif
 
 
 
 #else // INVERTED_PAGETABLE
-    ASSERT(numPages <= NumPhysPages);
+    ASSERT(numPages <= (unsigned) machine->numPhysPages);
+    int tid = currentThread->getTID();
+    int *frames = new int[numPages];
     for(int i=0; i<numPages; ++i)
     {
-        int physicalPage = machine->allocateMem();
-        //printf("%d\n", physicalPage);
-        machine->pageTable[physicalPage].virtualPage = i;
-        machine->pageTable[physicalPage].physicalPage = physicalPage;
-        machine->pageTable[physicalPage].valid = TRUE;
-        machine->pageTable[physicalPage].use = FALSE;
-        machine->pageTable[physicalPage].readOnly = FALSE;
-        machine->pageTable[physicalPage].dirty = FALSE;
-        machine->pageTable[physicalPage].TID = currentThread->getTID();
-        for(int j=0; j<PageSize; ++j)
-        {
-            machine->mainMemory[physicalPage*PageSize+j] = 0;
-        }
+        frames[i] = machine->allocateMem();
+        machine->MapFrame(frames[i], tid, i);
+        bzero(&(machine->mainMemory[frames[i]*PageSize]), PageSize);
+        machine->InvalidateFrame(frames[i]);
     }
     
-    printf("================PAGE TABLE================\n");
-    for(int i=0; i<NumPhysPages; ++i)
-    {
-        printf("%d\t%d\t%d\t%d\n", machine->pageTable[i].virtualPage, machine->pageTable[i].physicalPage, 
-                machine->pageTable[i].valid, machine->pageTable[i].TID);
-    }
-    printf("==========================================\n");
-    // allocate data and code sections, we need to translate sections' virtualAddr to physicalAddr
-    // one byte per loop
-    for(int VA=noffH.code.virtualAddr, cnt=0; VA<noffH.code.size; ++VA, ++cnt)
+    machine->PrintPageTable();
+    // copy in the code and data sections, each into the frames of its
+    // pages
+    CopySegment(executable, &noffH.code, frames);
+    CopySegment(executable, &noffH.initData, frames);
+    delete [] frames;
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddrSpace
+// 	Create the address space of a child of Fork, as a copy-on-write
+//	copy of "parent", the current address space, whose TLB the 
+//	caller has already synced and flushed.
+//
+//	Every page the parent has in memory is shared: both page tables
+//	map the same frame, read-only, and the first write from either
+//	side takes a private copy (see CopyOnWriteHandler).  Only the
+//	pages the parent has out in the swap area are copied now, into
+//	slots of the child's; the rest come from the executable for both.  A
+//	shared page counts as dirty in the child if the executable does
+//	not hold it as it is.
+//----------------------------------------------------------------------
+
+AddrSpace::AddrSpace(AddrSpace *parent)
+{
+#ifndef INVERTED_PAGETABLE
+    numPages = parent->numPages;
+    exeSector = parent->exeSector;
+    noffH = parent->noffH;
+    zeroFillFrom = parent->zeroFillFrom;
+    spaceId = SpaceCnt++;
+    asid = -1;
+    exeFile = NULL;
+    swapSlot = NULL;
+    nextFault = -1;
+    readAhead = 0;
+    runTicks = runStart = 0;
+    resident = 0;
+    quota = WorkingSetMin;
+    suspended = FALSE;
+    faults = 0;
+    lastSample = 0;
+
+#ifdef USE_DISK
+    exeFile = new OpenFile(exeSector);
+    swapSlot = new int[numPages];
+    char *buf = new char[PageSize];
+#endif
+
+    pageTable = new TranslationEntry[numPages];
+    for (unsigned int i = 0; i < numPages; i++)
     {
-        unsigned int VPN = VA / PageSize;
-        unsigned int PPN = 0;
-        for(PPN=0; PPN<NumPhysPages; ++PPN)
+        TranslationEntry *from = &parent->pageTable[i];
+
+        pageTable[i] = *from;
+        if (from->valid)                // share the frame
         {
-            if(machine->pageTable[PPN].valid && machine->pageTable[PPN].virtualPage==VPN 
-                && machine->pageTable[PPN].TID == currentThread->getTID())
-                break;
+            machine->coreMap[from->physicalPage].refs++;
+            from->readOnly = TRUE;
+            pageTable[i].readOnly = TRUE;
+            pageTable[i].use = FALSE;
+            resident++;
+#ifdef USE_DISK
+            pageTable[i].dirty = from->dirty || parent->swapSlot[i] != -1;
+#else
+            pageTable[i].dirty = TRUE;
+#endif
         }
-        unsigned int PPO = VA % PageSize;
-        unsigned int PA = PPN*PageSize + PPO;
-        //printf("%d 0x%x %d 0x%x\n", PA, PA, VA, VA);
-        executable->ReadAt(&(machine->mainMemory[PA]),
-			1, noffH.code.inFileAddr+cnt);
-	//printf("%d 0x%x\n", machine->mainMemory[PA], machine->mainMemory[PA]);
-    }
-    
-    for(int VA=noffH.initData.virtualAddr, cnt=0; VA<noffH.initData.size; ++VA, ++cnt)
-    {
-        unsigned int VPN = VA / PageSize;
-        unsigned int PPN = 0;
-        for(PPN=0; PPN<NumPhysPages; ++PPN)
-        {
-            if(machine->pageTable[PPN].valid && machine->pageTable[PPN].virtualPage==VPN 
-                && machine->pageTable[PPN].TID == currentThread->getTID())
-                break;
+#ifdef USE_DISK
+        swapSlot[i] = -1;
+        if (!from->valid && parent->swapSlot[i] != -1)  // copy the page
+        {                                               // on disk
+            swapSpace->Read(parent->swapSlot[i], buf, 1);
+            PageOut(i, buf, 1);
         }
-        unsigned int PPO = VA % PageSize;
-        unsigned int PA = PPN*PageSize + PPO;
-        //printf("%d 0x%x %d 0x%x\n", PA, PA, VA, VA);
-        executable->ReadAt(&(machine->mainMemory[PA]),
-			1, noffH.initData.inFileAddr+cnt);
-	//printf("%d 0x%x\n", machine->mainMemory[PA], machine->mainMemory[PA]);
+#endif
     }
+
+#ifdef USE_DISK
+    delete [] buf;
+#endif
+#else // INVERTED_PAGETABLE
+    ASSERT(FALSE);      // one inverted table cannot map a frame twice
 #endif
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.  Nothing for now!
+// 	Dealloate an address space, and give back its address space ID
+//	and its swap slots.
 //----------------------------------------------------------------------
 
+static AddrSpace *asidOwner[NumASIDs];	// who has each address space ID
+static int nextRecycled = 0;		// the ID to take back next
+
 AddrSpace::~AddrSpace()
 {
+#ifdef USE_TLB
+   if (asid != -1)
+   {
+       machine->FlushTLB(asid);
+       machine->asidPageTable[asid] = NULL;
+       asidOwner[asid] = NULL;
+   }
+#endif
    delete pageTable;
+   if (exeFile != NULL)
+       delete exeFile;
+#ifdef USE_DISK
+   if (swapSlot != NULL)
+   {
+       for (unsigned int i = 0; i < numPages; i++)
+           if (swapSlot[i] != -1)
+               swapSpace->Free(swapSlot[i]);
+       delete [] swapSlot;
+   }
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -316,36 +389,115 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	Only the user instructions run so far are saved, for VirtualTime.
+//	The software TLB holds translations of
+//	this address space, so it is flushed; the TLB entries are tagged
+//	with our address space ID, so they can stay for when we run again.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState() 
 {
+    runTicks += stats->userTicks - runStart;
+    machine->FlushSoftTLB();
+#ifdef INVERTED_PAGETABLE
+    FlushTLB();		// its TLB entries carry no address space ID
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FlushTLB
+// 	Drop the TLB entries of this address space, saving their use and
+//	dirty bits, because its page table is about to change in a way 
+//	the TLB cannot be left to see (see Fork).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::FlushTLB()
+{
+    machine->FlushSoftTLB();
 #ifdef USE_TLB
-    DEBUG('T', "Clean up TLB when context switch occurs!\n");
-    for(int i=0; i<TLBSize; ++i)
+#ifdef INVERTED_PAGETABLE
+    for(int i=0; i<machine->tlbSize; ++i)
     {
         machine->tlb[i].valid = FALSE;
     }
+#else
+    if (asid != -1)
+        machine->FlushTLB(asid);
+#endif
 #endif
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::AllocateASID
+// 	Give this address space an ID to tag its TLB entries with: a free
+//	one if there is any, else one taken back from another space, in
+//	turn.  Only then is the TLB flushed, and only of that ID's entries.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::AllocateASID()
+{
+    int id;
+
+    for (id = 0; id < NumASIDs && asidOwner[id] != NULL; id++)
+        ;
+    if (id == NumASIDs)
+    {
+        id = nextRecycled;
+        nextRecycled = (nextRecycled + 1) % NumASIDs;
+        DEBUG('T', "Recycle address space ID %d of space %d\n", 
+            id, asidOwner[id]->spaceId);
+        machine->FlushTLB(id);
+        asidOwner[id]->asid = -1;
+        stats->numASIDRecycles++;
+    }
+    asidOwner[id] = this;
+    asid = id;
+    machine->asidPageTable[id] = pageTable;
+    machine->asidPageTableSize[id] = numPages;
+}
+
 //----------------------------------------------------------------------
 // AddrSpace::RestoreState
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      For now, tell the machine where to find the page table and
+//	which address space ID to match TLB entries on, and flush the
+//	software TLB in case the kernel changed it meanwhile.  Note when
+//	we started running, for VirtualTime.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
+    runStart = stats->userTicks;
+    machine->FlushSoftTLB();
 #ifndef INVERTED_PAGETABLE
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
+#ifdef USE_TLB
+    if (asid == -1)
+        AllocateASID();
+    machine->currentASID = asid;
+#endif
 #endif
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::VirtualTime
+// 	Return how many user instructions this address space has run.
+//	Page fault rates are measured against this, not against the
+//	total time, which grows with every other program running too.
+//	Only meaningful while this space is the running one.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::VirtualTime()
+{
+    return runTicks + stats->userTicks - runStart;
+}
+
 
 void
 AddrSpace::PrintAddrState() 
@@ -380,12 +532,284 @@ AddrSpace::CopyTable(AddrSpace* space)
 void
 AddrSpace::WriteBackAll()
 {
-    OpenFile *vm = fileSystem->Open(currentThread->space->VMName);
-	ASSERT(vm!=NULL);
     for(int i=0; i<numPages; ++i)
     {
-        if(pageTable[i].valid)
-            vm->WriteAt(&(machine->mainMemory[PageSize*pageTable[i].physicalPage]), PageSize, i*PageSize);
+        if(pageTable[i].valid && pageTable[i].dirty)
+        {
+            PageOut(i, &(machine->mainMemory[PageSize*pageTable[i].physicalPage]), 1);
+            pageTable[i].dirty = FALSE;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::IsCodePage
+// 	Return TRUE if page "vpn" lies entirely within the code segment.
+//	Such pages are mapped read-only, and are never saved to swap.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::IsCodePage(int vpn)
+{
+    return noffH.code.size > 0 && vpn*PageSize >= noffH.code.virtualAddr
+        && (vpn+1)*PageSize <= noffH.code.virtualAddr + noffH.code.size;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SameBacking
+// 	Return TRUE if page "other", not in memory, is kept where page
+//	"vpn" is, so that both can be read in one go: in swap slots as far
+//	apart as the pages are, or both in the executable.  Zero-filled 
+//	pages need no reading, and are never read ahead.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::SameBacking(int vpn, int other)
+{
+    if ((unsigned) other >= numPages || pageTable[other].valid)
+        return FALSE;
+    if (swapSlot[vpn] != -1)
+        return swapSlot[other] == swapSlot[vpn] + (other - vpn);
+    return swapSlot[other] == -1 && other < zeroFillFrom;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReadAheadSize
+// 	Called on a page fault on "vpn": return how many of the pages
+//	after it to bring in as well.  As long as the program keeps
+//	faulting on the page right after the last ones brought in, the
+//	window doubles, up to ReadAheadMax; any other fault closes it.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::ReadAheadSize(int vpn)
+{
+    int count = 0;
+
+    if (vpn == nextFault)
+        readAhead = min(max(2*readAhead, 1), ReadAheadMax);
+    else
+        readAhead = 0;
+    while (count < readAhead && SameBacking(vpn, vpn + count + 1))
+        count++;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// LoadSegment
+// 	Read the part of "segment" that falls in the "count" pages from
+//	"vpn" on from the executable into "pages", their contents in 
+//	memory.  The sectors the read spans are counted as paging I/O.
+//----------------------------------------------------------------------
+
+static void
+LoadSegment(OpenFile *executable, Segment *segment, int vpn, int count,
+    char *pages)
+{
+    int start = max(segment->virtualAddr, vpn*PageSize);
+    int end = min(segment->virtualAddr + segment->size, (vpn+count)*PageSize);
+    int position = segment->inFileAddr + start - segment->virtualAddr;
+
+    if (start < end)
+    {
+        executable->ReadAt(&pages[start - vpn*PageSize], end - start,
+            position);
+        stats->numPagingReads += divRoundDown(position + end - start - 1,
+            SectorSize) - divRoundDown(position, SectorSize) + 1;
     }
-    delete vm;
 }
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+// 	Bring the "count" pages from "vpn" on into physical "frames".  A 
+//	page saved to the swap area is read from there; any other page
+//	has never been modified, and is read from the code and initialized
+//	data in the executable, the rest of it zero.  Code pages are made
+//	read-only.
+//
+//	The pages must all be kept in the same place (see SameBacking),
+//	so that they are all brought in in one pass over the sectors
+//	holding them.
+//
+//	The bss and stack pages hold nothing from the executable, so the
+//	first time they are touched the frame is just zeroed, and no disk
+//	I/O is done at all.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::PageIn(int vpn, int *frames, int count)
+{
+    char *pages = &(machine->mainMemory[PageSize*frames[0]]);
+    int i;
+
+    ASSERT(exeFile != NULL);
+    if (count > 1)
+        pages = new char[count*PageSize];
+#ifdef USE_DISK
+    if (swapSlot[vpn] != -1)
+        swapSpace->Read(swapSlot[vpn], pages, count);
+    else
+#endif
+    if (vpn >= zeroFillFrom)
+    {
+        ASSERT(count == 1);
+        bzero(pages, PageSize);
+        stats->numZeroFillFaults++;
+    }
+    else
+    {
+        bzero(pages, count*PageSize);
+        LoadSegment(exeFile, &noffH.code, vpn, count, pages);
+        LoadSegment(exeFile, &noffH.initData, vpn, count, pages);
+    }
+    if (count > 1)
+    {
+        for (i = 0; i < count; i++)
+            bcopy(&pages[i*PageSize], 
+                &(machine->mainMemory[PageSize*frames[i]]), PageSize);
+        delete [] pages;
+    }
+    for (i = 0; i < count; i++)
+        pageTable[vpn+i].readOnly = IsCodePage(vpn+i);
+    nextFault = vpn + count;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageOut
+// 	Save the "count" pages from "vpn" on, whose contents are at 
+//	"from", to the swap area; from now on they are paged in from 
+//	there.  A page is given a slot the first time it is saved, and
+//	keeps it.  Pages that all need one get slots in a row if there
+//	are any, and each run of pages in consecutive slots is written in
+//	one sequential sweep.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::PageOut(int vpn, char *from, int count)
+{
+#ifndef USE_DISK
+    ASSERT(FALSE);			// there is no swap area
+#else
+    int i, first;
+
+    for (i = 0; i < count && swapSlot[vpn+i] == -1; i++)
+        ;
+    if (i == count && (first = swapSpace->Allocate(count)) != -1)
+        for (i = 0; i < count; i++)
+            swapSlot[vpn+i] = first + i;
+    for (i = 0; i < count; i++)
+    {
+        if (swapSlot[vpn+i] == -1)
+            swapSlot[vpn+i] = swapSpace->Allocate(1);
+        ASSERT(swapSlot[vpn+i] != -1);		// swap area is full
+    }
+
+    for (i = 0; i < count; i = first)
+    {
+        for (first = i+1; first < count 
+                && swapSlot[vpn+first] == swapSlot[vpn+i] + (first-i); first++)
+            ;
+        swapSpace->Write(swapSlot[vpn+i], &from[i*PageSize], first - i);
+    }
+#endif
+}
+
+#ifdef USE_DISK
+//----------------------------------------------------------------------
+// SwapSpace::SwapSpace
+// 	Set up the swap area, all of its slots free.  The file system
+//	keeps its sectors, at the end of the disk, out of its free map.
+//	With the stub file system there is no disk, so the slots go to
+//	a UNIX file of the same layout; "fileSystem" must be set up first.
+//----------------------------------------------------------------------
+
+SwapSpace::SwapSpace()
+{
+    slots = new BitMap(NumSwapSlots);
+#ifdef FILESYS_STUB
+    bool created = fileSystem->Create(SwapFileName, NumSwapSlots * PageSize);
+    ASSERT(created);
+    swapFile = fileSystem->Open(SwapFileName);
+    ASSERT(swapFile != NULL);
+#endif
+}
+
+SwapSpace::~SwapSpace()
+{
+    delete slots;
+#ifdef FILESYS_STUB
+    delete swapFile;
+    fileSystem->Remove(SwapFileName);
+#endif
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Allocate
+// 	Find "count" free slots in a row, mark them in use and return
+//	the first, or -1 if there is no such run.
+//----------------------------------------------------------------------
+
+int
+SwapSpace::Allocate(int count)
+{
+    int first, i;
+
+    for (first = 0; first + count <= NumSwapSlots; first = i + 1)
+    {
+        for (i = first; i < first + count && !slots->Test(i); i++)
+            ;
+        if (i == first + count)
+        {
+            for (i = first; i < first + count; i++)
+                slots->Mark(i);
+            return first;
+        }
+    }
+    return -1;
+}
+
+void
+SwapSpace::Free(int slot)
+{
+    ASSERT(slots->Test(slot));
+    slots->Clear(slot);
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Read, SwapSpace::Write
+// 	Move "count" pages between memory and the slots from "slot" on,
+//	one sector after another.  The sectors moved are counted as 
+//	paging I/O here, rather than from the disk's own counts, which 
+//	other threads add to while this one waits for the disk.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Read(int slot, char *into, int count)
+{
+    ASSERT(slot >= 0 && slot + count <= NumSwapSlots);
+#ifdef FILESYS_STUB
+    swapFile->ReadAt(into, count * PageSize, slot * PageSize);
+#else
+    int sector = SwapSector + slot * SectorsPerSlot;
+
+    for (int i = 0; i < count * SectorsPerSlot; i++)
+        synchDisk->ReadSector(sector + i, &into[i * SectorSize]);
+#endif
+    stats->numPagingReads += count * SectorsPerSlot;
+}
+
+void
+SwapSpace::Write(int slot, char *from, int count)
+{
+    ASSERT(slot >= 0 && slot + count <= NumSwapSlots);
+#ifdef FILESYS_STUB
+    swapFile->WriteAt(from, count * PageSize, slot * PageSize);
+#else
+    int sector = SwapSector + slot * SectorsPerSlot;
+
+    for (int i = 0; i < count * SectorsPerSlot; i++)
+        synchDisk->WriteSector(sector + i, &from[i * SectorSize]);
+#endif
+    stats->numPagingWrites += count * SectorsPerSlot;
+}
+#endif // USE_DISK
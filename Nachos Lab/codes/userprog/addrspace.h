@@ -15,14 +15,59 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "bitmap.h"
+#include "noff.h"
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxReadAhead		32	// most pages -ra may read ahead
+#define WorkingSetWindow	1000	// user instructions between samples
+					// of a working set
+#define WorkingSetMin		2	// frames any process may keep
+
+#ifdef USE_DISK
+#define SectorsPerSlot	divRoundUp(PageSize, SectorSize)
+#define NumSwapSlots	(NumSwapSectors / SectorsPerSlot)
+#ifdef FILESYS_STUB
+#define SwapFileName	"SWAP"	// stands in for the swap sectors
+#endif
+
+// The following class manages the swap area: the sectors at the end of 
+// the disk where pages evicted dirty are kept, a page per slot, out of
+// the file system's way.  Slots for neighboring pages are handed out
+// in a row where possible, so that the pages go to and from the disk
+// in one sequential sweep.
+
+class SwapSpace {
+  public:
+    SwapSpace();			// All slots free
+    ~SwapSpace();
+
+    int Allocate(int count);		// Take "count" free slots in a row;
+					// return the first, or -1 if none
+    void Free(int slot);		// Give back a slot
+
+    void Read(int slot, char *into, int count);
+    void Write(int slot, char *from, int count);
+					// Move "count" pages to or from
+					// the slots from "slot" on
+
+  private:
+    BitMap *slots;			// which slots are in use
+#ifdef FILESYS_STUB
+    OpenFile *swapFile;			// no disk without the real file
+					// system: keep the slots in a
+					// UNIX file instead
+#endif
+};
+#endif
 
 class AddrSpace {
   public:
     AddrSpace(OpenFile *executable);	// Create an address space,
 					// initializing it with the program
 					// stored in the file "executable"
+    AddrSpace(AddrSpace *parent);	// Create a copy-on-write copy of
+					// "parent", for Fork
     ~AddrSpace();			// De-allocate an address space
 
     void InitRegisters();		// Initialize user-level CPU registers,
@@ -30,6 +75,8 @@ class AddrSpace {
 
     void SaveState();			// Save/restore address space-specific
     void RestoreState();		// info on a context switch 
+    void FlushTLB();			// Drop this space's TLB entries
+    int GetASID() { return asid; }	// TLB tag, -1 if it has none now
 
     void PrintAddrState();
 
@@ -37,15 +84,59 @@ class AddrSpace {
     void WriteBackAll(); 
     TranslationEntry* GetPageTable() { return pageTable; }
     int GetNumPages() {return numPages;}
+
+    bool IsCodePage(int vpn);		// does page "vpn" hold only code?
+    int ReadAheadSize(int vpn);		// how many pages to read after
+					// "vpn", on a fault on it
+    void PageIn(int vpn, int *frames, int count);
+					// fill "frames" with the "count"
+					// pages from "vpn" on
+    void PageOut(int vpn, char *from, int count);
+					// save the "count" pages from "vpn"
+					// on, at "from", to the swap area
  
-    char* VMName;
+    int spaceId;			// numbers the space, for debugging
     int exeSector;
 
+    // working set control, with USE_DISK (see SampleWorkingSet)
+    int resident;			// pages it has in memory
+    int quota;				// frames it keeps when memory runs
+					// short: its working set
+    bool suspended;			// swapped out, until its working
+					// set fits in memory again
+    int faults;				// page faults it has taken
+    int lastSample;			// VirtualTime of the last sample
+    int VirtualTime();			// user instructions it has run
+
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    NoffHeader noffH;			// where the segments lie in the
+					// executable
+    int zeroFillFrom;			// first page past the code and
+					// initialized data: the bss and
+					// stack, which start out zero
+    OpenFile *exeFile;			// the executable, which clean code
+					// and data pages are paged in from;
+					// NULL unless USE_DISK
+    int *swapSlot;			// where each page has been saved in
+					// the swap area, -1 if it has not;
+					// NULL unless USE_DISK
+    int asid;				// address space ID tagging our TLB
+					// entries, -1 until we next run
+    void AllocateASID();		// take a free ID, or recycle one
+
+    int nextFault;			// the fault that would continue a
+					// sequential run of faults
+    int readAhead;			// current read-ahead window, in pages
+    int runTicks;			// user instructions run up to the
+					// last SaveState
+    int runStart;			// stats->userTicks at RestoreState
+
+    bool SameBacking(int vpn, int other);	// can "other" be read
+					// in one go with "vpn"?
 };
 
 class ForkInfo
@@ -25,142 +25,803 @@
 #include "system.h"
 #include "syscall.h"
 
-#ifdef USE_FIFO
-void
-TLBFIFO(TranslationEntry page)
+//----------------------------------------------------------------------
+// TLBPolicy
+// 	How a TLB miss picks the entry to replace, when every entry of
+//	the set the missing page maps to is in use (see Machine::TLBSet).
+//	"set" is the first entry of that set; the set has tlbWays entries.
+//	Chosen at startup with -tlbpolicy.
+//----------------------------------------------------------------------
+
+class TLBPolicy {
+  public:
+    virtual ~TLBPolicy() {}
+    virtual char* Name() = 0;
+    virtual int Victim(int set) = 0;	// entry of the full "set" to replace
+    virtual void Loaded(int entry) {}	// "entry" was just loaded
+};
+
+// replace the entry loaded longest ago
+class FIFOPolicy : public TLBPolicy {
+  public:
+    FIFOPolicy()
+    {
+	loadedAt = new unsigned int[machine->tlbSize];
+	for(int i=0; i<machine->tlbSize; ++i)
+		loadedAt[i] = 0;
+	loads = 0;
+    }
+    char* Name() { return "FIFO"; }
+    int Victim(int set)
+    {
+	int victim = set;
+	for(int i=set+1; i<set+machine->tlbWays; ++i)
+		if(loadedAt[i] < loadedAt[victim])
+			victim = i;
+	DEBUG('m', "===> FIFO replaces TLB entry %d.\n", victim);
+	return victim;
+    }
+    void Loaded(int entry) { loadedAt[entry] = ++loads; }
+
+  private:
+    unsigned int* loadedAt;	// "loads" when each entry was loaded
+    unsigned int loads;
+};
+
+// give each entry used since the hand last passed another chance
+class ClockPolicy : public TLBPolicy {
+  public:
+    ClockPolicy()
+    {
+	int sets = machine->tlbSize / machine->tlbWays;
+	hand = new int[sets];
+	for(int i=0; i<sets; ++i)
+		hand[i] = 0;
+    }
+    char* Name() { return "CLOCK"; }
+    int Victim(int set)
+    {
+	int* h = &hand[set / machine->tlbWays];
+	while(machine->tlb[set + *h].use)	// the miss synced the use bits
+	{
+		DEBUG('m', "===> Item %d can be given another chance.\n", set + *h);
+		machine->tlb[set + *h].use = FALSE;
+		*h = (*h + 1) % machine->tlbWays;
+	}
+	int victim = set + *h;
+	*h = (*h + 1) % machine->tlbWays;
+	DEBUG('m', "===> CLOCK replaces TLB entry %d.\n", victim);
+	return victim;
+    }
+    void Loaded(int entry) { machine->tlb[entry].use = TRUE; }
+
+  private:
+    int* hand;			// next way to look at, in each set
+};
+
+// replace the entry hit least recently; Translate stamps the hits
+class LRUPolicy : public TLBPolicy {
+  public:
+    char* Name() { return "LRU"; }
+    int Victim(int set)
+    {
+	int victim = set;
+	for(int i=set+1; i<set+machine->tlbWays; ++i)
+		if(machine->tlbStamp[i] < machine->tlbStamp[victim])
+			victim = i;
+	DEBUG('m', "===> LRU replaces TLB entry %d.\n", victim);
+	return victim;
+    }
+    void Loaded(int entry) { machine->tlbStamp[entry] = ++machine->tlbTicks; }
+};
+
+class RandomPolicy : public TLBPolicy {
+  public:
+    char* Name() { return "random"; }
+    int Victim(int set) { return set + Random() % machine->tlbWays; }
+};
+
+static TLBPolicy* tlbPolicy = NULL;
+
+static TLBPolicy*
+CurrentTLBPolicy()
 {
-	DEBUG('m', "===> Now use FIFO algotithm to exchange TLB item.\n");
-	int idx = -1;
-	
-	for(int i=0; i<TLBSize; ++i)
+	if(tlbPolicy == NULL)
 	{
-		if(machine->tlb[i].valid == FALSE) // find a n unused item
+		switch(TLBReplacement)
 		{
-			idx = i;
-			DEBUG('m', "===> Find a free item in TLB.\n");
-			break;
+		case TLBReplaceFIFO:	tlbPolicy = new FIFOPolicy; break;
+		case TLBReplaceClock:	tlbPolicy = new ClockPolicy; break;
+		case TLBReplaceLRU:	tlbPolicy = new LRUPolicy; break;
+		default:		tlbPolicy = new RandomPolicy; break;
 		}
 	}
-	
-	if(idx == -1) // all items are used
+	return tlbPolicy;
+}
+
+//----------------------------------------------------------------------
+// TLBInsert
+// 	Load "page" into a free entry of its set, or else into the one
+//	the replacement policy picks.  The caller synced the TLB first, 
+//	so the entry replaced has no use or dirty bits to lose.
+//----------------------------------------------------------------------
+
+static void
+TLBInsert(TranslationEntry page)
+{
+	int set = machine->TLBSet(page.virtualPage);
+	int victim = -1;
+
+	for(int i=set; i<set+machine->tlbWays; ++i)
 	{
-		DEBUG('m', "===> We need to remove the first page in TLB.\n");
-		for(int i=0; i<TLBSize-1; ++i)
+		if(machine->tlb[i].valid == FALSE)
 		{
-			machine->tlb[i] = machine->tlb[i+1];
+			DEBUG('m', "===> Find a free item in TLB.\n");
+			victim = i;
+			break;
 		}
-		idx = TLBSize - 1;
 	}
-	
-	machine->tlb[idx] = page;
+	if(victim == -1)
+		victim = CurrentTLBPolicy()->Victim(set);
+	machine->tlb[victim] = page;
+	CurrentTLBPolicy()->Loaded(victim);
 }
+
+//----------------------------------------------------------------------
+// TLBEntry
+// 	Return the TLB entry translating page "vpn" of "space", or NULL.
+//	TLB entries are tagged by address space ID, so those of other 
+//	address spaces than the running one may be there as well.
+//----------------------------------------------------------------------
+
+static TranslationEntry*
+TLBEntry(AddrSpace* space, int vpn)
+{
+#ifdef USE_TLB
+	int set = machine->TLBSet(vpn);
+	for(int i=set; i<set+machine->tlbWays; ++i)
+		if(machine->tlb[i].valid && machine->tlb[i].asid == space->GetASID()
+			&& machine->tlb[i].virtualPage == vpn)
+			return &machine->tlb[i];
 #endif
+	return NULL;
+}
+
+//----------------------------------------------------------------------
+// FrameMappers
+// 	Put in "spaces" every address space whose page table maps
+//	"frame", and return how many there are.  A frame shared by a
+//	copy-on-write Fork is at the same vpn in every space mapping it,
+//	but the core map remembers only one of them, so when it is
+//	shared the others are looked up through the thread table.
+//----------------------------------------------------------------------
 
-int Index = 0;
+static int
+FrameMappers(int frame, AddrSpace** spaces)
+{
+	CoreMapEntry* owner = &machine->coreMap[frame];
+	int n = 0;
 
-#ifdef USE_CLOCK
-void
-TLBClock(TranslationEntry page)
+	if(owner->refs == 1 && owner->space != NULL)
+	{
+		spaces[0] = owner->space;
+		return 1;
+	}
+	for(int i=0; i<MAX_THREAD_NUM; ++i)
+	{
+		if(!used_TID[i] || Thread_Pointer[i] == NULL)
+			continue;
+		AddrSpace* space = Thread_Pointer[i]->space;
+		if(space == NULL || owner->vpn >= space->GetNumPages())
+			continue;
+		TranslationEntry* entry = &space->GetPageTable()[owner->vpn];
+		if(!entry->valid || entry->physicalPage != frame)
+			continue;
+		int j;
+		for(j=0; j<n && spaces[j]!=space; ++j)
+			;
+		if(j == n)
+			spaces[n++] = space;
+	}
+	return n;
+}
+
+//----------------------------------------------------------------------
+// ReplacePage
+// 	Free a physical frame by evicting the page in it, choosing among
+//	the pages of every process with the second-chance (CLOCK)
+//	algorithm: the clock hand sweeps the core map, clearing the use
+//	bit of recently referenced pages and taking the first page found
+//	unreferenced.  A modified victim is written back to its owner's
+//	virtual memory file.  On the first sweep, the frames of other
+//	processes that hold no more than their quota (see 
+//	SampleWorkingSet) are left alone.  Each frame is passed over at
+//	most once per sweep, so a victim turns up within three sweeps.
+//
+//	A frame shared after a copy-on-write Fork counts as referenced
+//	if any of its mappers referenced it; evicting it unmaps it from
+//	all of them, each getting its own copy on disk if it needs one.
+//
+//	Frames busy with paging I/O are passed over.  The victim is 
+//	unmapped before it is written back, and stays busy until the
+//	caller has filled and mapped it again; a fault on the evicted page
+//	meanwhile waits for the write (see PageInTransit).
+//----------------------------------------------------------------------
+
+int
+ReplacePage()
 {
-	DEBUG('m', "===> Now use CLOCK algotithm to exchange TLB item.\n");
-	while(true)
+	AddrSpace* current = currentThread->space;
+	AddrSpace* mappers[MAX_THREAD_NUM];
+	bool dirty[MAX_THREAD_NUM];
+	int looked = 0;			// frames considered, over all sweeps
+
+	machine->SyncTLB();
+	for(int step=0; ; ++step)
 	{
-		if(machine->tlb[Index].valid == FALSE) // there is a free item
+		if(step == 3*machine->numPhysPages)	// every frame is busy
 		{
-			DEBUG('m', "===> Find a free item in TLB.\n");
-			break;
+			currentThread->Yield();
+			step = 0;
+#ifdef USE_BITMAP
+			int free = machine->allocateMem();	// the pager may
+			if(free != -1)				// have freed one
+				return free;
+#endif
 		}
-		else // this item is occupied
+		int frame = machine->clockHand;
+		machine->clockHand = (machine->clockHand + 1) % machine->numPhysPages;
+
+		CoreMapEntry* owner = &machine->coreMap[frame];
+		if(owner->busy || owner->refs == 0)
+			continue;
+		if(looked++ < machine->numPhysPages && owner->refs == 1
+			&& owner->space != NULL && owner->space != current 
+			&& owner->space->resident <= owner->space->quota)
+			continue;	// within its working set: look on first
+		int n = FrameMappers(frame, mappers);
+
+		bool used = FALSE;
+		for(int m=0; m<n; ++m)
 		{
-			if(machine->tlb[Index].use) // just used once
+			TranslationEntry* entry = &mappers[m]->GetPageTable()[owner->vpn];
+			if(!entry->use)
+				continue;
+			// referenced since the hand last passed: spare it
+			used = TRUE;
+			entry->use = FALSE;
+			TranslationEntry* cached = TLBEntry(mappers[m], owner->vpn);
+			if(cached != NULL)
+				cached->use = FALSE;
+		}
+		if(used)
+			continue;
+
+		for(int m=0; m<n; ++m)
+		{
+			TranslationEntry* entry = &mappers[m]->GetPageTable()[owner->vpn];
+			DEBUG('P', "===> Evict vpn %d of space %d from frame %d%s.\n", owner->vpn,
+				mappers[m]->spaceId, frame, entry->dirty ? ", writing it back" : "");
+			dirty[m] = entry->dirty;
+			entry->valid = FALSE;
+			mappers[m]->resident--;
+			entry->dirty = FALSE;
+			entry->readOnly = FALSE;	// it comes back private
+			TranslationEntry* cached = TLBEntry(mappers[m], owner->vpn);
+			if(cached != NULL)	// its translation may still be cached
+				cached->valid = FALSE;
+			if(mappers[m] == current)
+				machine->FlushSoftTLB();
+		}
+		owner->busy = TRUE;
+		for(int m=0; m<n; ++m)
+			if(dirty[m])		// other threads run during the write
+				mappers[m]->PageOut(owner->vpn, &(machine->mainMemory[PageSize*frame]), 1);
+		owner->space = NULL;
+		owner->vpn = -1;
+		owner->refs = 0;
+		owner->prefetched = FALSE;
+		return frame;
+	}
+}
+
+//----------------------------------------------------------------------
+// PageInTransit
+// 	Return TRUE if page "vpn" of "space" may be in a frame that is
+//	still being written back, and so cannot be read in yet.  The core
+//	map may not know which of several spaces a shared frame belonged
+//	to, so this errs on the side of TRUE.
+//----------------------------------------------------------------------
+
+static bool
+PageInTransit(AddrSpace* space, int vpn)
+{
+	for(int i=0; i<machine->numPhysPages; ++i)
+	{
+		CoreMapEntry* owner = &machine->coreMap[i];
+		if(owner->busy && owner->vpn == vpn 
+			&& (owner->space == space || owner->space == NULL))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+//----------------------------------------------------------------------
+// WaitForPaging
+// 	Wait until no frame is busy with paging I/O.  Called before an
+//	address space goes away or is copied by Fork, since a page of it
+//	might be on its way to the swap area.
+//----------------------------------------------------------------------
+
+void
+WaitForPaging()
+{
+	for(int i=0; i<machine->numPhysPages; ++i)
+	{
+		while(machine->coreMap[i].busy)
+			currentThread->Yield();
+	}
+}
+
+#ifdef USE_BITMAP
+//----------------------------------------------------------------------
+// The pager
+// 	A kernel thread that frees frames ahead of page faults, so that
+//	they seldom have to evict, and hardly ever wait for a dirty page
+//	to be written back.  Woken when fewer than PagerLowWater frames
+//	are free, it sweeps the same clock as ReplacePage until
+//	PagerHighWater frames are free, or it has gone round twice.
+//
+//	An unreferenced clean page is unmapped and its frame freed at
+//	once.  An unreferenced dirty page is first written to swap while
+//	still mapped, its owner free to run meanwhile; if the owner uses
+//	the page again during the write, it stays mapped, and if it
+//	modified it, it is still dirty.  Shared frames are left to
+//	ReplacePage.
+//----------------------------------------------------------------------
+
+#define PagerLowWater	4	// wake the pager below this many free frames
+#define PagerHighWater	8	// the pager stops at this many
+#define PagerCluster	4	// most neighboring pages written back at once
+
+static Semaphore* pagerWakeup = NULL;
+
+//----------------------------------------------------------------------
+// Cleanable
+// 	Return TRUE if the pager may write back page "vpn" of "space" 
+//	along with the page before it: a dirty, unreferenced page alone
+//	in a frame that is not busy.
+//----------------------------------------------------------------------
+
+static bool
+Cleanable(AddrSpace* space, int vpn)
+{
+	if(vpn >= space->GetNumPages())
+		return FALSE;
+	TranslationEntry* entry = &space->GetPageTable()[vpn];
+	if(!entry->valid || !entry->dirty || entry->use)
+		return FALSE;
+	CoreMapEntry* owner = &machine->coreMap[entry->physicalPage];
+	return !owner->busy && owner->refs == 1 && owner->space == space;
+}
+
+//----------------------------------------------------------------------
+// PagerFree
+// 	Unmap page "vpn" of "space" and free its frame, unless it has
+//	been referenced or modified since the pager last looked.
+//----------------------------------------------------------------------
+
+static void
+PagerFree(AddrSpace* space, int vpn)
+{
+	TranslationEntry* entry = &space->GetPageTable()[vpn];
+
+	if(entry->use || entry->dirty)
+		return;			// the owner got to it first
+	DEBUG('P', "===> Pager frees frame %d, vpn %d of space %d.\n", 
+		entry->physicalPage, vpn, space->spaceId);
+	TranslationEntry* cached = TLBEntry(space, vpn);
+	if(cached != NULL)
+		cached->valid = FALSE;
+	entry->valid = FALSE;
+	entry->readOnly = FALSE;
+	space->resident--;
+	machine->coreMap[entry->physicalPage].prefetched = FALSE;
+	machine->freeFrame(entry->physicalPage);
+	stats->numPagerFrees++;
+}
+
+//----------------------------------------------------------------------
+// PagerThread
+// 	The body of the pager.  A dirty page is written back together
+//	with up to PagerCluster-1 dirty, unreferenced pages that follow
+//	it, into consecutive swap slots, and so in one sequential sweep
+//	of the disk.
+//----------------------------------------------------------------------
+
+static void
+PagerThread(int dummy)
+{
+	char pages[PagerCluster*PageSize];
+
+	while(TRUE)
+	{
+		pagerWakeup->P();
+		// the TLB keeps entries of every address space; fold their
+		// use and dirty bits into the page tables before looking
+		machine->SyncTLB();
+		for(int step=0; step<2*machine->numPhysPages 
+			&& machine->numFreeFrames()<PagerHighWater; ++step)
+		{
+			int frame = machine->clockHand;
+			machine->clockHand = (machine->clockHand + 1) % machine->numPhysPages;
+
+			CoreMapEntry* owner = &machine->coreMap[frame];
+			if(owner->busy || owner->refs != 1 || owner->space == NULL)
+				continue;
+			AddrSpace* space = owner->space;
+			TranslationEntry* table = space->GetPageTable();
+			int vpn = owner->vpn;
+			if(table[vpn].use)
+			{
+				table[vpn].use = FALSE;
+				TranslationEntry* cached = TLBEntry(space, vpn);
+				if(cached != NULL)
+					cached->use = FALSE;
+				continue;
+			}
+			if(!table[vpn].dirty)
 			{
-				DEBUG('m', "===> Item %d can be given another chance.\n", Index);
-				machine->tlb[Index].use = FALSE;
-				Index = (Index +1) % TLBSize;
+				PagerFree(space, vpn);
+				continue;
 			}
-			else // have given one chance
+
+			int count = 1;
+			while(count < PagerCluster && Cleanable(space, vpn + count))
+				count++;
+			DEBUG('P', "===> Pager cleans vpn %d-%d of space %d.\n", 
+				vpn, vpn+count-1, space->spaceId);
+			for(int i=0; i<count; ++i)
+			{
+				int physicalPage = table[vpn+i].physicalPage;
+				bcopy(&(machine->mainMemory[PageSize*physicalPage]), 
+					&pages[i*PageSize], PageSize);
+				table[vpn+i].dirty = FALSE;
+				TranslationEntry* cached = TLBEntry(space, vpn+i);
+				if(cached != NULL)	// a later write must show up
+					cached->valid = FALSE;
+				machine->coreMap[physicalPage].busy = TRUE;
+			}
+			space->PageOut(vpn, pages, count);	// the owner may run
+			stats->numPagerWrites += count;
+			machine->SyncTLB();	// and so have touched them again
+			for(int i=0; i<count; ++i)
 			{
-				DEBUG('m', "===> Item %d have been given extra chance.\n", Index);
-				break;
+				machine->coreMap[table[vpn+i].physicalPage].busy = FALSE;
+				PagerFree(space, vpn+i);
 			}
 		}
 	}
-	
-	// initialize new entry
-	machine->tlb[Index] = page;
-	machine->tlb[Index].use = TRUE;
 }
-#endif
 
-int
-ReplacePage()
+//----------------------------------------------------------------------
+// WakePager
+// 	Wake the pager, starting it the first time it is needed.
+//----------------------------------------------------------------------
+
+static void
+WakePager()
+{
+	if(pagerWakeup == NULL)
+	{
+		pagerWakeup = new Semaphore("pager wakeup", 0);
+		Thread* pager = new Thread("pager");
+		pager->Fork(PagerThread, (void*)0);
+	}
+	pagerWakeup->V();
+}
+
+//----------------------------------------------------------------------
+// Working set control
+// 	Each process has a quota of frames: its working set, the pages 
+//	it has referenced in its last WorkingSetWindow user instructions.
+//	It is measured at its page faults, once per window, by counting
+//	and clearing the use bits of its pages.  Since ReplacePage and
+//	the pager clear use bits too, this errs on the small side.
+//	ReplacePage leaves the frames of a process within its quota for
+//	last.
+//
+//	When the working sets of the processes in memory add up to more 
+//	than physical memory, they can only keep faulting each other's
+//	pages out.  Instead, processes with the largest working sets are
+//	swapped out whole, and held at their next page fault until their
+//	working set fits in memory again (see PageFaultHandler).
+//----------------------------------------------------------------------
+
+//----------------------------------------------------------------------
+// ActiveWorkingSets
+// 	Return the sum of the quotas of the processes not swapped out,
+//	other than "except".
+//----------------------------------------------------------------------
+
+static int
+ActiveWorkingSets(AddrSpace* except)
 {
-	DEBUG('P', "===> Try to find a physical page in current pagetable.\n");
-	int physicalPage = -1;
-	for(int i=0; i<machine->pageTableSize; ++i)
+	int sum = 0;
+
+	for(int i=0; i<MAX_THREAD_NUM; ++i)
 	{
-		if(machine->pageTable[i].valid)
+		if(!used_TID[i] || Thread_Pointer[i] == NULL)
+			continue;
+		AddrSpace* space = Thread_Pointer[i]->space;
+		if(space != NULL && space != except && !space->suspended)
+			sum += space->quota;
+	}
+	return sum;
+}
+
+//----------------------------------------------------------------------
+// SwapOut
+// 	Suspend "space", which is not the running one: write back its 
+//	dirty pages and free all its frames.  Frames shared after a Fork,
+//	or busy with paging I/O, are left where they are.
+//----------------------------------------------------------------------
+
+static void
+SwapOut(AddrSpace* space)
+{
+	TranslationEntry* table = space->GetPageTable();
+
+	DEBUG('P', "===> Swap out space %d, working set %d, %d pages in memory.\n", 
+		space->spaceId, space->quota, space->resident);
+	space->suspended = TRUE;
+	stats->numSwapOuts++;
+	for(int vpn=0; vpn<space->GetNumPages(); ++vpn)
+	{
+		TranslationEntry* entry = &table[vpn];
+		if(!entry->valid)
+			continue;
+		int frame = entry->physicalPage;
+		CoreMapEntry* owner = &machine->coreMap[frame];
+		if(owner->busy || owner->refs != 1)
+			continue;
+
+		machine->SyncTLB();	// it may have run during the last write
+		TranslationEntry* cached = TLBEntry(space, vpn);
+		if(cached != NULL)
+			cached->valid = FALSE;
+		bool dirty = entry->dirty;
+		entry->valid = FALSE;
+		entry->dirty = FALSE;
+		entry->readOnly = FALSE;
+		space->resident--;
+		owner->busy = TRUE;
+		if(dirty)		// other threads run during the write
+			space->PageOut(vpn, &(machine->mainMemory[PageSize*frame]), 1);
+		owner->busy = FALSE;
+		owner->prefetched = FALSE;
+		machine->freeFrame(frame);
+		stats->numSwappedPages++;
+	}
+}
+
+//----------------------------------------------------------------------
+// SampleWorkingSet
+// 	Measure the working set of "space", the running one, and make it
+//	its quota.  Then, while the working sets of the processes in 
+//	memory do not fit in it, swap out the one with the largest.
+//----------------------------------------------------------------------
+
+static void
+SampleWorkingSet(AddrSpace* space)
+{
+	TranslationEntry* table = space->GetPageTable();
+	int referenced = 0;
+
+	machine->SyncTLB();
+	for(int vpn=0; vpn<space->GetNumPages(); ++vpn)
+	{
+		if(!table[vpn].valid || !table[vpn].use)
+			continue;
+		referenced++;
+		table[vpn].use = FALSE;
+		TranslationEntry* cached = TLBEntry(space, vpn);
+		if(cached != NULL)
+			cached->use = FALSE;
+	}
+	space->quota = max(referenced, WorkingSetMin);
+	space->lastSample = space->VirtualTime();
+	DEBUG('P', "===> Working set of space %d is %d pages.\n", 
+		space->spaceId, space->quota);
+
+	while(ActiveWorkingSets(NULL) > machine->numPhysPages)
+	{
+		AddrSpace* victim = NULL;
+		for(int i=0; i<MAX_THREAD_NUM; ++i)
 		{
-			if(!machine->pageTable[i].dirty)
-			{
-				DEBUG('P', "===> Find an unmodified physical page.\n");
-				machine->pageTable[i].valid = FALSE;
-				physicalPage = machine->pageTable[i].physicalPage;
-				break;
-			}
+			if(!used_TID[i] || Thread_Pointer[i] == NULL)
+				continue;
+			AddrSpace* other = Thread_Pointer[i]->space;
+			if(other != NULL && other != space && !other->suspended
+				&& (victim == NULL || other->quota > victim->quota))
+				victim = other;
 		}
+		if(victim == NULL)	// ours alone is too large
+			break;
+		SwapOut(victim);
 	}
-	if(physicalPage == -1) // all has been modified
+}
+
+//----------------------------------------------------------------------
+// WaitToSwapIn
+// 	Hold "space", the running one, while it is swapped out, until
+//	its working set fits in memory along with those of the processes
+//	in memory, or that many frames are free.
+//----------------------------------------------------------------------
+
+static void
+WaitToSwapIn(AddrSpace* space)
+{
+	while(space->suspended)
 	{
-		for(int i=0; i<machine->pageTableSize; ++i)
+		if(ActiveWorkingSets(space) + space->quota <= machine->numPhysPages
+			|| machine->numFreeFrames() >= space->quota)
 		{
-			if(machine->pageTable[i].valid)
-			{
-				DEBUG('P', "===> Find a modified physical page.\n");
-				machine->pageTable[i].valid = FALSE;
-				physicalPage = machine->pageTable[i].physicalPage;
-				
-				OpenFile *vm = fileSystem->Open(currentThread->space->VMName);
-				ASSERT(vm!=NULL);
-				vm->WriteAt(&(machine->mainMemory[PageSize*machine->pageTable[i].physicalPage]), PageSize, i*PageSize);
-				delete vm;
-				break;
-			}
+			DEBUG('P', "===> Swap in space %d.\n", space->spaceId);
+			space->suspended = FALSE;
+			break;
 		}
+		currentThread->Yield();
 	}
-	return physicalPage;
 }
+#endif // USE_BITMAP
 
 
+//----------------------------------------------------------------------
+// PageFaultHandler
+// 	Bring page "vpn" of the current address space into memory,
+//	evicting some page if no frame is free.
+//
+//	If the program is faulting its way sequentially through its pages,
+//	the pages after "vpn" are read ahead in the same disk operation,
+//	but only into frames that are free: read-ahead never evicts.
+//----------------------------------------------------------------------
+
 void
 PageFaultHandler(int vpn)
 {
-	int physicalPage = -1;
+	AddrSpace* space = currentThread->space;
+	int frames[1 + MaxReadAhead];
+	int count = 1;
+
+#ifdef USE_BITMAP
+	WaitToSwapIn(space);
+	space->faults++;
+	if(space->VirtualTime() - space->lastSample >= WorkingSetWindow)
+		SampleWorkingSet(space);
+#endif
+	while(PageInTransit(space, vpn))	// let the write finish
+		currentThread->Yield();
+
+	frames[0] = -1;
 #ifdef USE_BITMAP
-	physicalPage = machine->allocateMem();
+	frames[0] = machine->allocateMem();
 #else
 	ASSERT(FALSE);
 #endif
-	if(physicalPage == -1)
+	if(frames[0] == -1)
 	{
-		physicalPage = ReplacePage();
+		frames[0] = ReplacePage();
 	}
-	machine->pageTable[vpn].physicalPage = physicalPage;
-	
-	DEBUG('P', "Load page from virtual memory %s\n", currentThread->space->VMName);
-	OpenFile *vm = fileSystem->Open(currentThread->space->VMName);
-	ASSERT(vm!=NULL);
-	vm->ReadAt(&(machine->mainMemory[PageSize*physicalPage]), PageSize, vpn*PageSize);
-	delete vm;
+#ifdef USE_BITMAP
+	// stop short of a page still being written back: its swap slot
+	// may not hold it yet, or not be recorded yet
+	int ahead = space->ReadAheadSize(vpn);
+	while(count <= ahead && !PageInTransit(space, vpn+count)
+		&& (frames[count] = machine->allocateMem()) != -1)
+		count++;
+	if(machine->numFreeFrames() < PagerLowWater)
+		WakePager();
+#endif
+
+	DEBUG('P', "Load pages %d-%d of space %d\n", vpn, vpn+count-1, space->spaceId);
+	for(int i=0; i<count; ++i)	// reading into them may block
+	{
+		machine->coreMap[frames[i]].space = space;
+		machine->coreMap[frames[i]].vpn = vpn+i;
+		machine->coreMap[frames[i]].busy = TRUE;
+	}
+	space->PageIn(vpn, frames, count);	// sets readOnly
+	space->resident += count;
+	stats->numPageFaults++;
+	stats->numPrefetched += count - 1;
+	for(int i=0; i<count; ++i)
+	{
+		int physicalPage = frames[i];
+		machine->coreMap[physicalPage].refs = 1;
+		machine->coreMap[physicalPage].prefetched = (i > 0);
+		machine->coreMap[physicalPage].busy = FALSE;
+		machine->InvalidateFrame(physicalPage);
 	
-	machine->pageTable[vpn].valid = TRUE;
-	machine->pageTable[vpn].use = FALSE;
-	machine->pageTable[vpn].dirty = FALSE;
-	machine->pageTable[vpn].readOnly = FALSE;
+		machine->pageTable[vpn+i].physicalPage = physicalPage;
+		machine->pageTable[vpn+i].valid = TRUE;
+		machine->pageTable[vpn+i].use = FALSE;
+		machine->pageTable[vpn+i].dirty = FALSE;
+	}
 	
 	//currentThread->space->PrintAddrState();
 }
 
+//----------------------------------------------------------------------
+// CopyOnWriteHandler
+// 	Handle a write to a read-only page other than code, which can
+//	only be one a copy-on-write Fork shares between parent and child:
+//	give the writer a private copy of the frame -- or, if nobody
+//	else maps the frame any more, just make the page writable again.
+//	The faulting instruction is then restarted.
+//----------------------------------------------------------------------
+
+void
+CopyOnWriteHandler(int addr)
+{
+	AddrSpace* space = currentThread->space;
+	unsigned int vpn = (unsigned) addr / PageSize;
+	ASSERT(vpn < (unsigned) space->GetNumPages());
+	TranslationEntry* entry = &machine->pageTable[vpn];
+	ASSERT(entry->valid && entry->readOnly);
+
+	int frame = entry->physicalPage;
+	if(machine->coreMap[frame].refs > 1)
+	{
+		char copy[PageSize];
+		memcpy(copy, &(machine->mainMemory[PageSize*frame]), PageSize);
+
+		int newFrame = -1;
+#ifdef USE_BITMAP
+		newFrame = machine->allocateMem();
+#endif
+#ifdef USE_DISK
+		if(newFrame == -1)
+			newFrame = ReplacePage();
+#endif
+		ASSERT(newFrame != -1);
+		DEBUG('P', "===> Copy on write: vpn %d, frame %d -> %d.\n", vpn, frame, newFrame);
+
+		// ReplacePage may have evicted the shared frame itself, and
+		// our mapping with it; if not, let go of it
+		if(entry->valid && entry->physicalPage == frame)
+		{
+			machine->coreMap[frame].refs--;
+			if(machine->coreMap[frame].space == space)
+				machine->coreMap[frame].space = NULL;
+		}
+		else
+			space->resident++;	// we map a page again
+		memcpy(&(machine->mainMemory[PageSize*newFrame]), copy, PageSize);
+		machine->InvalidateFrame(newFrame);
+		machine->coreMap[newFrame].space = space;
+		machine->coreMap[newFrame].vpn = vpn;
+		machine->coreMap[newFrame].refs = 1;
+		machine->coreMap[newFrame].prefetched = FALSE;
+		machine->coreMap[newFrame].busy = FALSE;
+		entry->physicalPage = newFrame;
+		entry->valid = TRUE;
+		entry->dirty = TRUE;
+	}
+	else
+	{
+		DEBUG('P', "===> Copy on write: vpn %d is no longer shared.\n", vpn);
+		machine->coreMap[frame].space = space;
+	}
+	entry->readOnly = FALSE;
+	entry->use = TRUE;
+
+	TranslationEntry* cached = TLBEntry(space, vpn);
+	if(cached != NULL)
+		cached->valid = FALSE;	// reload the writable entry
+	machine->FlushSoftTLB();
+}
+
 void
 TLBMissHandler(int addr)
 {
@@ -168,31 +829,34 @@ TLBMissHandler(int addr)
 
 	unsigned int vpn = (unsigned) addr / PageSize;
 	//unsigned int offset = (unsigned) addr % PageSize;  // Maybe we'll not use this.
-	TranslationEntry page = machine->pageTable[vpn];
+	machine->SyncTLB();	// an entry is about to be replaced
 #ifndef USE_DISK
-	ASSERT(page.valid);
+	ASSERT(machine->pageTable[vpn].valid);
 #else
-	if(!page.valid)
+	if(!machine->pageTable[vpn].valid)
 	{
 		DEBUG('P', "===> Page Miss Found, vpn is %d 0x%x!\n", vpn, vpn);
 		PageFaultHandler(vpn);
 	}
+	if(machine->coreMap[machine->pageTable[vpn].physicalPage].prefetched)
+	{
+		// first reference to a page read ahead
+		machine->coreMap[machine->pageTable[vpn].physicalPage].prefetched = FALSE;
+		stats->numPrefetchHits++;
+	}
 #endif
+	TranslationEntry page = machine->pageTable[vpn];
+	page.asid = machine->currentASID;
 
-#ifdef USE_FIFO
-	TLBFIFO(page);
-#elif USE_CLOCK
-	TLBClock(page);
-#else
-	machine->tlb[Index] = page;
-	Index = (Index + 1) % TLBSize;
-#endif
+	TLBInsert(page);
 }
 
 void
 TLBMissRate()
 {
 #ifdef USE_TLB
+	printf("TLB of %d entries, %d-way set associative, %s replacement.\n",
+	machine->tlbSize, machine->tlbWays, CurrentTLBPolicy()->Name());
 	printf("Total translation count is %d, translation missing count is %d, miss rate is %.6f.\n", 
 	totalcnt-misscnt, misscnt, misscnt*1.0 / (totalcnt-misscnt));
 #endif
@@ -201,24 +865,119 @@ TLBMissRate()
 
 /********************************* about system call *********************************/
 
+//----------------------------------------------------------------------
+// UserToHost
+// 	Translate the user address "virtAddr" and return where it is in
+//	mainMemory.  A TLB miss, page fault or copy-on-write fault is 
+//	serviced, as ReadMem's callers do by retrying, and the translation
+//	made again.  One access can take all three in turn (a write to a
+//	page shared after Fork misses the TLB, then finds the entry it
+//	loaded read-only), so up to MaxTranslateRetries are made; anything
+//	else wrong with the address is fatal.
+//
+//	Translations are made one page at a time by the Copy routines
+//	below, which then move up to a page with memcpy, instead of
+//	going through ReadMem or WriteMem for every byte.
+//----------------------------------------------------------------------
+
+#define MaxTranslateRetries	3	// TLB miss, page fault, copy on write
+
+static char *
+UserToHost(int virtAddr, bool writing)
+{
+	int physAddr;
+	ExceptionType exception;
+
+	exception = machine->Translate(virtAddr, &physAddr, 1, writing);
+	for (int retries = 0; exception != NoException; retries++) {
+		ASSERT(retries < MaxTranslateRetries);
+#ifdef USE_TLB
+		if (exception == PageFaultException)
+			misscnt++;
+#endif
+		machine->RaiseException(exception, virtAddr);
+		exception = machine->Translate(virtAddr, &physAddr, 1, writing);
+	}
+	return &machine->mainMemory[physAddr];
+}
+
+//----------------------------------------------------------------------
+// CopyFromUser
+// 	Copy "size" bytes at user address "virtAddr" into "buffer".
+//----------------------------------------------------------------------
+
+void
+CopyFromUser(int virtAddr, char *buffer, int size)
+{
+	while (size > 0) {
+		int chunk = min(size, PageSize - virtAddr % PageSize);
+
+		memcpy(buffer, UserToHost(virtAddr, FALSE), chunk);
+		virtAddr += chunk;
+		buffer += chunk;
+		size -= chunk;
+	}
+}
+
+//----------------------------------------------------------------------
+// CopyToUser
+// 	Copy "size" bytes of "buffer" to user address "virtAddr".  The
+//	pages written may hold code, so their predecoded instructions
+//	are dropped, as WriteMem does.
+//----------------------------------------------------------------------
+
+void
+CopyToUser(int virtAddr, char *buffer, int size)
+{
+	while (size > 0) {
+		int chunk = min(size, PageSize - virtAddr % PageSize);
+		char *host = UserToHost(virtAddr, TRUE);
+
+		memcpy(host, buffer, chunk);
+		machine->InvalidateFrame((host - machine->mainMemory) / PageSize);
+		virtAddr += chunk;
+		buffer += chunk;
+		size -= chunk;
+	}
+}
+
+//----------------------------------------------------------------------
+// CopyStringFromUser
+// 	Copy the null-terminated string at user address "virtAddr",
+//	null included, into "buffer", which holds "maxLen" bytes.
+//	The string must fit.  Returns its length.
+//----------------------------------------------------------------------
+
+int
+CopyStringFromUser(int virtAddr, char *buffer, int maxLen)
+{
+	int len = 0;
+
+	while (len < maxLen) {
+		int chunk = min(maxLen - len, PageSize - virtAddr % PageSize);
+		char *host = UserToHost(virtAddr, FALSE);
+		char *end = (char *) memchr(host, '\0', chunk);
+
+		if (end != NULL) {
+			memcpy(buffer + len, host, end - host + 1);
+			return len + (end - host);
+		}
+		memcpy(buffer + len, host, chunk);
+		virtAddr += chunk;
+		len += chunk;
+	}
+	ASSERT(FALSE);		// should not be too long
+	return -1;
+}
+
 #define FileNameMaxLen 		85
 
 char*
 GetFileName(int address)
 {
-	int pos = 0;
-	int data;
 	char* fileName = new char[FileNameMaxLen+1];
 
-	do
-	{
-		// the first time might meet TLB miss
-		if(!machine->ReadMem(address+pos, 1, &data)) 
-			ASSERT(machine->ReadMem(address+pos, 1, &data));
-		fileName[pos++] = (char)data;
-		ASSERT(pos <= FileNameMaxLen); // should not be too long
-	} while (data != '\0');
-	fileName[pos] = '\0';
+	CopyStringFromUser(address, fileName, FileNameMaxLen);
 
 	// printf("name is %s \n", fileName);
 	return fileName;	
@@ -334,23 +1093,12 @@ ForkHandler()
 	// get func ptr, also regarded as new PC for child thread
 	int addr = machine->ReadRegister(4);
 
-	// update vm and initialize new space
-	currentThread->space->WriteBackAll();
-	OpenFile* executable = new OpenFile(currentThread->space->exeSector);
-	AddrSpace* addrSpace = new AddrSpace(executable);
-	delete executable;
-	// addrSpace->CopyTable(currentThread->space);
-
-	DEBUG('S', "---flush virtual memory from %s to %s---\n", currentThread->space->VMName, addrSpace->VMName);
-	OpenFile* vm = fileSystem->Open(currentThread->space->VMName);
-	OpenFile* nextvm = fileSystem->Open(addrSpace->VMName);
-	ASSERT(vm != NULL && nextvm != NULL);
-	int size = currentThread->space->GetNumPages()*PageSize;
-	char* buf = new char[size];
-	vm->Read(buf, size);
-	nextvm->Write(buf, size);
-	delete vm; delete nextvm;
-	DEBUG('S', "---finish flush virtual memory---\n");
+	// share the parent's memory with the new space, copy-on-write;
+	// the parent's pages turn read-only, so flush its TLB first
+	WaitForPaging();
+	currentThread->space->FlushTLB();
+	AddrSpace* addrSpace = new AddrSpace(currentThread->space);
+	DEBUG('S', "---space %d shares memory with space %d---\n", addrSpace->spaceId, currentThread->space->spaceId);
 
 	// initialize info
 	ForkInfo* info = new ForkInfo;
@@ -359,6 +1107,7 @@ ForkHandler()
 
 	// execute fork function
 	Thread* thread = new Thread("created by Fork Syscall");
+	thread->space = addrSpace;	// so page replacement sees its mappings
 	thread->Fork(ForkFunc, (void*)info);
 
 	// copy open-file table
@@ -400,26 +1149,24 @@ ExitHandler()
 #ifdef USER_PROGRAM
 	if(currentThread->space != NULL)
 	{
+		WaitForPaging();	// no page of ours may be on its way out
+#ifdef USE_DISK
+		AddrSpace* space = currentThread->space;
+		DEBUG('P', "Space %d: %d page faults in %d instructions (%.2f per 1000), working set %d pages\n",
+			space->spaceId, space->faults, space->VirtualTime(),
+			1000.0 * space->faults / max(space->VirtualTime(), 1), space->quota);
+#endif
 #if USE_BITMAP || INVERTED_PAGETABLE
 		machine->freeMem();
 #endif
-		currentThread->space->SaveState(); // clear tlb when current thread exits
+		currentThread->space->FlushTLB(); // clear tlb when current thread exits
 
-		// should delete virtual memory file
-		// printf("---%s---\n", currentThread->space->VMName);
-		fileSystem->Remove(currentThread->space->VMName);
-
-		delete currentThread->space;
+		delete currentThread->space;	// frees its swap slots
 		currentThread->space = NULL;
 	}
 	
 #ifdef INVERTED_PAGETABLE
-	printf("================PAGE TABLE================\n");
-	for(int i=0; i<NumPhysPages; ++i)
-	{
-		printf("%d\t%d\t%d\t%d\n", machine->pageTable[i].virtualPage, machine->pageTable[i].physicalPage, machine->pageTable[i].valid, machine->pageTable[i].TID);
-	}
-	printf("==========================================\n");
+	machine->PrintPageTable();
 #endif
 
 #endif
@@ -523,11 +1270,7 @@ ReadHandler()
 	
 	// write to memory
 	// printf("\nread content %s\n\n", buffer);
-	for(int i=0; i<numBytes; ++i)
-	{
-		if(!machine->WriteMem(addr+i, 1, (int)buffer[i]))
-			machine->WriteMem(addr+i, 1, (int)buffer[i]);
-	}
+	CopyToUser(addr, buffer, numBytes);
 
 	// set return value and PC
 	machine->WriteRegister(2, numBytes);
@@ -545,11 +1288,7 @@ WriteHandler()
 
 	// get content(read memory)
 	char* buffer = new char[size+1];
-	for(int i=0; i<size; ++i)
-	{
-		if(!machine->ReadMem(addr+i, 1, (int*)&buffer[i]));
-			machine->ReadMem(addr+i, 1, (int*)&buffer[i]);
-	}
+	CopyFromUser(addr, buffer, size);
 	buffer[size] = '\0'; // ensure content
 
 	// write to file
@@ -628,10 +1367,27 @@ ExceptionHandler(ExceptionType which)
 	
 	/* added by leesou 1800012826 Lab4 Exercise 2 */
 
+	if (which == ReadOnlyException)
+	{
+		int addr = machine->ReadRegister(BadVAddrReg);
+		if(!currentThread->space->IsCodePage(addr / PageSize))
+		{
+			CopyOnWriteHandler(addr);
+			return;
+		}
+		printf("Write to code at 0x%x\n", addr);	// a real protection fault
+		ASSERT(FALSE);
+	}
+
 	if (which == SyscallException) 
 	{
 		if(type == SC_Halt)
 		{
+			if (BenchMode)	// the benchmark driver runs more
+			{		// programs after this one
+				machine->WriteRegister(4, 0);
+				ExitHandler();
+			}
 			DEBUG('a', "Shutdown, initiated by user program.\n");
 			TLBMissRate();
 #ifdef USER_PROGRAM
@@ -115,6 +115,111 @@ StartProcess(char *filename)
 					// by doing the syscall "exit"
 }
 
+//----------------------------------------------------------------------
+// Benchmark
+// 	Measure the speed of the user program simulator.  Each benchmark
+//	program is run "runs" times, one run at a time, each in a fresh
+//	address space and thread; we wait for it to exit, as Join does.
+//	Halt ends only the program while we are running (see BenchMode).
+//
+//	When all runs are done, print one CSV line per run: host wall
+//	time of the run (loading excluded), user instructions simulated,
+//	millions of simulated instructions per host second, TLB miss
+//	rate (computed as TLBMissRate does), and page faults.
+//
+//	With a real file system, the programs must first be copied in,
+//	e.g. "nachos -f -cp ../test/sort sort ... -bench 5".
+//----------------------------------------------------------------------
+
+#ifdef FILESYS
+static char *benchPrograms[] = { "matmult", "sort", "arrayAdd" };
+#else
+static char *benchPrograms[] = { "../test/matmult", "../test/sort",
+				 "../test/arrayAdd" };
+#endif
+#define NumBenchPrograms (sizeof(benchPrograms) / sizeof(char *))
+
+class BenchResult {
+  public:
+    char *program;
+    int run;
+    double wallTime;		// host seconds
+    int instructions;		// user instructions simulated
+    int references;		// address translations, and
+    int misses;			// the TLB misses among them
+    int pageFaults;
+};
+
+static void
+BenchThread(int arg)
+{
+    currentThread->space->InitRegisters();
+    currentThread->space->RestoreState();
+    machine->Run();
+    ASSERT(FALSE);
+}
+
+void
+Benchmark(int runs)
+{
+    BenchResult *results = new BenchResult[NumBenchPrograms * runs];
+    int n = 0;
+
+    BenchMode = TRUE;
+    for (unsigned int p = 0; p < NumBenchPrograms; p++) {
+	for (int r = 1; r <= runs; r++) {
+	    OpenFile *executable = fileSystem->Open(benchPrograms[p]);
+	    if (executable == NULL) {
+		printf("Unable to open file %s\n", benchPrograms[p]);
+		break;
+	    }
+	    Thread *thread = new Thread("benchmark");
+	    thread->space = new AddrSpace(executable);
+	    delete executable;
+
+	    BenchResult *result = &results[n++];
+	    int tid = thread->getTID();
+	    int instructions = stats->userTicks / UserTick;
+	    int faults = stats->numPageFaults;
+#ifdef USE_TLB
+	    int references = totalcnt, misses = misscnt;
+#endif
+	    double start = HostWallTime();
+
+	    thread->Fork(BenchThread, 0);
+	    while (used_TID[tid])
+		currentThread->Yield();
+
+	    result->wallTime = HostWallTime() - start;
+	    result->program = benchPrograms[p];
+	    result->run = r;
+	    result->instructions = stats->userTicks / UserTick - instructions;
+	    result->pageFaults = stats->numPageFaults - faults;
+#ifdef USE_TLB
+	    result->misses = misscnt - misses;
+	    result->references = totalcnt - references - result->misses;
+#else
+	    result->misses = result->references = 0;
+#endif
+	}
+    }
+    BenchMode = FALSE;
+
+    printf("program,run,wall_seconds,instructions,mips,tlb_miss_rate,"
+	"page_faults\n");
+    for (int i = 0; i < n; i++) {
+	BenchResult *result = &results[i];
+	printf("%s,%d,%.6f,%d,%.3f,%.6f,%d\n", result->program, result->run,
+	    result->wallTime, result->instructions,
+	    result->wallTime > 0 ?
+		result->instructions / result->wallTime / 1000000.0 : 0.0,
+	    result->references > 0 ?
+		(double) result->misses / result->references : 0.0,
+	    result->pageFaults);
+    }
+    delete [] results;
+}
+
 // Data structures needed for the console test.  Threads making
 // I/O requests wait on a Semaphore to delay until the I/O completes.
 